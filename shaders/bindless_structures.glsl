@@ -0,0 +1,18 @@
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "scene_data.glsl"
+
+struct MaterialData {
+  vec4 colorFactors;
+  vec4 metal_rough_factors;
+  uint colorTexture;
+  uint metalRoughTexture;
+};
+
+// every material texture, indexed by the slots in MaterialData
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(set = 1, binding = 1) readonly buffer MaterialTable {
+  MaterialData materials[];
+}
+materialTable;
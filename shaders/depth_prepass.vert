@@ -0,0 +1,47 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "scene_data.glsl"
+
+// the color pass tests EQUAL against this depth, so both shaders have to
+// compute the exact same position
+invariant gl_Position;
+
+layout(buffer_reference, std430) readonly buffer PositionBuffer {
+  float positions[];
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer {
+  vec4 unused;
+};
+
+struct InstanceData {
+  mat4 renderMatrix;
+  VertexBuffer vertexBuffer;
+  PositionBuffer positionBuffer;
+  uint materialIndex;
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer {
+  InstanceData instances[];
+};
+
+layout(push_constant) uniform constants {
+  InstanceBuffer instanceBuffer;
+}
+PushConstants;
+
+void main() {
+  InstanceData instance =
+      PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+
+  // positions are packed as 3 floats, vec3 arrays would pad to 16 bytes
+  uint base = gl_VertexIndex * 3;
+  vec4 position = vec4(instance.positionBuffer.positions[base],
+                       instance.positionBuffer.positions[base + 1],
+                       instance.positionBuffer.positions[base + 2], 1.0f);
+
+  gl_Position = sceneData.viewproj * instance.renderMatrix * position;
+}
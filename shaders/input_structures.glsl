@@ -1,13 +1,4 @@
-layout(set = 0, binding = 0) uniform SceneData {
-
-  mat4 view;
-  mat4 proj;
-  mat4 viewproj;
-  vec4 ambientColor;
-  vec4 sunlightDirection; // w for sun power
-  vec4 sunlightColor;
-}
-sceneData;
+#include "scene_data.glsl"
 
 layout(set = 1, binding = 0) uniform GLTFMaterialData {
 
@@ -9,6 +9,9 @@ layout(location = 0) out vec3 outNormal;
 layout(location = 1) out vec3 outColor;
 layout(location = 2) out vec2 outUV;
 
+// must match depth_prepass.vert bit for bit for the EQUAL depth test
+invariant gl_Position;
+
 struct Vertex {
 
   vec3 position;
@@ -22,21 +25,37 @@ layout(buffer_reference, std430) readonly buffer VertexBuffer {
   Vertex vertices[];
 };
 
+struct InstanceData {
+  mat4 renderMatrix;
+  VertexBuffer vertexBuffer;
+  // packed positions for the depth pre-pass
+  uvec2 positionBuffer;
+  uint materialIndex;
+};
+
+// one entry per instance, gl_InstanceIndex already includes the
+// firstInstance of the draw, direct or indirect
+layout(buffer_reference, std430) readonly buffer InstanceBuffer {
+  InstanceData instances[];
+};
+
 // push constants block
 layout(push_constant) uniform constants {
-  mat4 render_matrix;
-  VertexBuffer vertexBuffer;
+  InstanceBuffer instanceBuffer;
 }
 PushConstants;
 
 void main() {
-  Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+  InstanceData instance =
+      PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+  Vertex v = instance.vertexBuffer.vertices[gl_VertexIndex];
+  mat4 renderMatrix = instance.renderMatrix;
 
   vec4 position = vec4(v.position, 1.0f);
 
-  gl_Position = sceneData.viewproj * PushConstants.render_matrix * position;
+  gl_Position = sceneData.viewproj * renderMatrix * position;
 
-  outNormal = (PushConstants.render_matrix * vec4(v.normal, 0.f)).xyz;
+  outNormal = (renderMatrix * vec4(v.normal, 0.f)).xyz;
   outColor = v.color.xyz * materialData.colorFactors.xyz;
   outUV.x = v.uv_x;
   outUV.y = v.uv_y;
@@ -0,0 +1,26 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#include "bindless_structures.glsl"
+#include "irradiance.glsl"
+
+layout(location = 0) in vec3 inNormal;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) flat in uint inMaterial;
+
+layout(location = 0) out vec4 outFragColor;
+
+void main() {
+  float lightValue = max(dot(inNormal, vec3(0.3f, 1.f, 0.3f)), 0.1f);
+
+  vec3 irradiance = calcIrradiance(inNormal);
+
+  // instanced and indirect draws mix materials, the index is not uniform
+  uint colorTexture = materialTable.materials[inMaterial].colorTexture;
+  vec3 color =
+      inColor * texture(textures[nonuniformEXT(colorTexture)], inUV).xyz;
+
+  outFragColor =
+      vec4(color * lightValue + color * irradiance.x * vec3(0.2f), 1.0f);
+}
@@ -0,0 +1,61 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "bindless_structures.glsl"
+
+layout(location = 0) out vec3 outNormal;
+layout(location = 1) out vec3 outColor;
+layout(location = 2) out vec2 outUV;
+layout(location = 3) flat out uint outMaterial;
+
+// must match depth_prepass.vert bit for bit for the EQUAL depth test
+invariant gl_Position;
+
+struct Vertex {
+
+  vec3 position;
+  float uv_x;
+  vec3 normal;
+  float uv_y;
+  vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer {
+  Vertex vertices[];
+};
+
+struct InstanceData {
+  mat4 renderMatrix;
+  VertexBuffer vertexBuffer;
+  uvec2 positionBuffer;
+  uint materialIndex;
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer {
+  InstanceData instances[];
+};
+
+layout(push_constant) uniform constants {
+  InstanceBuffer instanceBuffer;
+}
+PushConstants;
+
+void main() {
+  InstanceData instance =
+      PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+  Vertex v = instance.vertexBuffer.vertices[gl_VertexIndex];
+  mat4 renderMatrix = instance.renderMatrix;
+  MaterialData material = materialTable.materials[instance.materialIndex];
+
+  vec4 position = vec4(v.position, 1.0f);
+
+  gl_Position = sceneData.viewproj * renderMatrix * position;
+
+  outNormal = (renderMatrix * vec4(v.normal, 0.f)).xyz;
+  outColor = v.color.xyz * material.colorFactors.xyz;
+  outUV.x = v.uv_x;
+  outUV.y = v.uv_y;
+  outMaterial = instance.materialIndex;
+}
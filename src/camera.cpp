@@ -1 +1,91 @@
 #include "camera.h"
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_access.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include <glm/gtx/transform.hpp>
+
+Frustum frustum_from_matrix(const glm::mat4 &viewproj) {
+  glm::vec4 row0 = glm::row(viewproj, 0);
+  glm::vec4 row1 = glm::row(viewproj, 1);
+  glm::vec4 row2 = glm::row(viewproj, 2);
+  glm::vec4 row3 = glm::row(viewproj, 3);
+
+  Frustum frustum;
+  frustum.planes[0] = row3 + row0;
+  frustum.planes[1] = row3 - row0;
+  frustum.planes[2] = row3 + row1;
+  frustum.planes[3] = row3 - row1;
+  // vulkan clip space depth runs from 0 to w
+  frustum.planes[4] = row2;
+  frustum.planes[5] = row3 - row2;
+
+  for (glm::vec4 &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+glm::mat4 Camera::get_view_matrix() const {
+  // the view matrix moves the world the opposite way the camera does
+  glm::mat4 cameraTranslation = glm::translate(glm::mat4(1.f), position);
+  glm::mat4 cameraRotation = get_rotation_matrix();
+  return glm::inverse(cameraTranslation * cameraRotation);
+}
+
+glm::mat4 Camera::get_rotation_matrix() const {
+  glm::quat pitchRotation = glm::angleAxis(pitch, glm::vec3{1.f, 0.f, 0.f});
+  glm::quat yawRotation = glm::angleAxis(yaw, glm::vec3{0.f, -1.f, 0.f});
+
+  return glm::toMat4(yawRotation) * glm::toMat4(pitchRotation);
+}
+
+glm::mat4 Camera::get_projection_matrix(float aspect) const {
+  // near and far swapped is all reverse-z needs
+  glm::mat4 proj =
+      glm::perspective(glm::radians(fov), aspect, farPlane, nearPlane);
+  proj[1][1] *= -1;
+  return proj;
+}
+
+void Camera::process_sdl_event(const SDL_Event &e) {
+  if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
+    float amount = e.type == SDL_KEYDOWN ? 1.f : 0.f;
+    switch (e.key.keysym.sym) {
+    case SDLK_w:
+      velocity.z = -amount;
+      break;
+    case SDLK_s:
+      velocity.z = amount;
+      break;
+    case SDLK_a:
+      velocity.x = -amount;
+      break;
+    case SDLK_d:
+      velocity.x = amount;
+      break;
+    case SDLK_q:
+      velocity.y = -amount;
+      break;
+    case SDLK_e:
+      velocity.y = amount;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (e.type == SDL_MOUSEMOTION && (e.motion.state & SDL_BUTTON_RMASK)) {
+    yaw += (float)e.motion.xrel / 200.f;
+    pitch -= (float)e.motion.yrel / 200.f;
+    // stop short of straight up and down, where yaw would flip
+    pitch = std::clamp(pitch, glm::radians(-89.f), glm::radians(89.f));
+  }
+}
+
+void Camera::update(float deltaTime) {
+  // velocity is in camera space
+  glm::vec3 move = velocity * speed * deltaTime;
+  position += glm::vec3(get_rotation_matrix() * glm::vec4(move, 0.f));
+}
@@ -1,7 +1,41 @@
+#pragma once
 
 #include <vk_types.h>
 
+#include <SDL2/SDL_events.h>
+
+// planes of the view volume pointing inwards, normal in xyz and distance in
+// w. Normalized, so plane distances are in world units
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+// works for any clip space with depth from 0 to w, reverse-z included
+Frustum frustum_from_matrix(const glm::mat4 &viewproj);
+
+// free flying camera. WASD moves, dragging with the right mouse button looks
+// around
 class Camera {
 public:
+  glm::vec3 velocity{0.f};
+  glm::vec3 position{0.f};
+  // radians, pitch up around x and yaw left around y
+  float pitch{0.f};
+  float yaw{0.f};
+
+  // vertical field of view in degrees
+  float fov{70.f};
+  float nearPlane{0.1f};
+  float farPlane{10000.f};
+  // units per second
+  float speed{5.f};
+
+  glm::mat4 get_view_matrix() const;
+  glm::mat4 get_rotation_matrix() const;
+  // reverse-z, the near plane lands on depth 1 and the far plane on 0. Y is
+  // flipped so +y is up like in opengl and gltf
+  glm::mat4 get_projection_matrix(float aspect) const;
 
+  void process_sdl_event(const SDL_Event &e);
+  void update(float deltaTime);
 };
@@ -0,0 +1,308 @@
+#include "vk_ktx.h"
+
+#include "vk_cpu_profiler.h"
+#include "vk_images.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace {
+//> ktx2_header
+constexpr uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K',  'T',  'X',  ' ',  '2',
+                                         '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct Ktx2Header {
+  uint8_t identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80);
+
+struct Ktx2LevelIndex {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+static_assert(sizeof(Ktx2LevelIndex) == 24);
+//< ktx2_header
+
+// copy offsets into the image must be a multiple of the block size, 16 covers
+// every format we load
+constexpr size_t LEVEL_ALIGNMENT = 16;
+
+size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//> bc_decode
+struct Rgba8 {
+  uint8_t r, g, b, a;
+};
+
+Rgba8 unpack_565(uint16_t c) {
+  uint8_t r = (c >> 11) & 31;
+  uint8_t g = (c >> 5) & 63;
+  uint8_t b = c & 31;
+  return Rgba8{uint8_t((r << 3) | (r >> 2)), uint8_t((g << 2) | (g >> 4)),
+               uint8_t((b << 3) | (b >> 2)), 255};
+}
+
+Rgba8 blend(Rgba8 a, Rgba8 b, int wa, int wb) {
+  int div = wa + wb;
+  return Rgba8{uint8_t((a.r * wa + b.r * wb) / div),
+               uint8_t((a.g * wa + b.g * wb) / div),
+               uint8_t((a.b * wa + b.b * wb) / div), 255};
+}
+
+// color part of BC1/BC2/BC3. The 3 color + transparent mode only exists in
+// BC1, the other formats always interpolate 4 colors
+void decode_color_block(const uint8_t *block, Rgba8 out[16], bool alwaysFour,
+                        bool punchThrough) {
+  uint16_t c0 = block[0] | (block[1] << 8);
+  uint16_t c1 = block[2] | (block[3] << 8);
+
+  Rgba8 palette[4];
+  palette[0] = unpack_565(c0);
+  palette[1] = unpack_565(c1);
+  if (c0 > c1 || alwaysFour) {
+    palette[2] = blend(palette[0], palette[1], 2, 1);
+    palette[3] = blend(palette[0], palette[1], 1, 2);
+  } else {
+    palette[2] = blend(palette[0], palette[1], 1, 1);
+    palette[3] = Rgba8{0, 0, 0, uint8_t(punchThrough ? 0 : 255)};
+  }
+
+  uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) |
+                     (uint32_t(block[7]) << 24);
+  for (int i = 0; i < 16; i++) {
+    out[i] = palette[(indices >> (2 * i)) & 3];
+  }
+}
+
+// single channel block used by BC3 alpha, BC4 and both halves of BC5
+void decode_channel_block(const uint8_t *block, uint8_t out[16]) {
+  int a0 = block[0];
+  int a1 = block[1];
+
+  uint8_t palette[8];
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int i = 1; i < 7; i++) {
+      palette[i + 1] = uint8_t(((7 - i) * a0 + i * a1) / 7);
+    }
+  } else {
+    for (int i = 1; i < 5; i++) {
+      palette[i + 1] = uint8_t(((5 - i) * a0 + i * a1) / 5);
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  uint64_t bits = 0;
+  for (int i = 0; i < 6; i++) {
+    bits |= uint64_t(block[2 + i]) << (8 * i);
+  }
+  for (int i = 0; i < 16; i++) {
+    out[i] = palette[(bits >> (3 * i)) & 7];
+  }
+}
+
+bool decode_bc_block(VkFormat format, const uint8_t *block, Rgba8 out[16]) {
+  uint8_t channel[16];
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    decode_color_block(block, out, false, false);
+    return true;
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    decode_color_block(block, out, false, true);
+    return true;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    decode_color_block(block + 8, out, true, false);
+    decode_channel_block(block, channel);
+    for (int i = 0; i < 16; i++) {
+      out[i].a = channel[i];
+    }
+    return true;
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    decode_channel_block(block, channel);
+    for (int i = 0; i < 16; i++) {
+      out[i] = Rgba8{channel[i], 0, 0, 255};
+    }
+    return true;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    decode_channel_block(block, channel);
+    for (int i = 0; i < 16; i++) {
+      out[i] = Rgba8{channel[i], 0, 0, 255};
+    }
+    decode_channel_block(block + 8, channel);
+    for (int i = 0; i < 16; i++) {
+      out[i].g = channel[i];
+    }
+    return true;
+  default:
+    return false;
+  }
+}
+//< bc_decode
+
+bool is_srgb_format(VkFormat format) {
+  return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+         format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+         format == VK_FORMAT_BC3_SRGB_BLOCK;
+}
+} // namespace
+
+std::optional<TextureData> loadKtx2Texture(std::filesystem::path filePath) {
+  CPU_ZONE("load ktx2");
+  std::ifstream file(filePath, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    fmt::println("Failed to open KTX2 file {}", filePath.string());
+    return {};
+  }
+
+  std::vector<uint8_t> raw((size_t)file.tellg());
+  file.seekg(0);
+  file.read((char *)raw.data(), raw.size());
+
+  Ktx2Header header;
+  if (raw.size() < sizeof(Ktx2Header)) {
+    fmt::println("KTX2 file {} is truncated", filePath.string());
+    return {};
+  }
+  memcpy(&header, raw.data(), sizeof(Ktx2Header));
+
+  if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) !=
+      0) {
+    fmt::println("{} is not a KTX2 file", filePath.string());
+    return {};
+  }
+
+  // basis universal files store VK_FORMAT_UNDEFINED and need a transcoder,
+  // cubemaps, arrays and 3d textures have no user in the engine yet
+  if (header.vkFormat == VK_FORMAT_UNDEFINED ||
+      header.supercompressionScheme != 0 || header.faceCount != 1 ||
+      header.layerCount > 1 || header.pixelDepth > 1 ||
+      header.pixelWidth == 0 || header.pixelHeight == 0) {
+    fmt::println("KTX2 file {} uses an unsupported layout", filePath.string());
+    return {};
+  }
+
+  TextureData texture;
+  texture.format = (VkFormat)header.vkFormat;
+  texture.extent = VkExtent3D{header.pixelWidth, header.pixelHeight, 1};
+
+  if (vkutil::format_block(texture.format).bytes == 0) {
+    fmt::println("KTX2 file {} uses unknown format {}", filePath.string(),
+                 string_VkFormat(texture.format));
+    return {};
+  }
+
+  // a level count of 0 asks the loader to generate mips, we only use level 0
+  uint32_t levelCount = std::max(header.levelCount, 1u);
+  // more levels than the mip chain has would not fit the image
+  if (levelCount >
+      vkutil::mip_level_count({header.pixelWidth, header.pixelHeight})) {
+    fmt::println("KTX2 file {} has {} levels, more than its size allows",
+                 filePath.string(), levelCount);
+    return {};
+  }
+  size_t indexEnd =
+      sizeof(Ktx2Header) + size_t(levelCount) * sizeof(Ktx2LevelIndex);
+  if (raw.size() < indexEnd) {
+    fmt::println("KTX2 file {} is truncated", filePath.string());
+    return {};
+  }
+
+  size_t packedSize = 0;
+  for (uint32_t i = 0; i < levelCount; i++) {
+    Ktx2LevelIndex index;
+    memcpy(&index, raw.data() + sizeof(Ktx2Header) + i * sizeof(Ktx2LevelIndex),
+           sizeof(Ktx2LevelIndex));
+
+    TextureLevel level;
+    level.extent = vkutil::mip_level_extent(texture.extent, i);
+    level.size = vkutil::image_level_size(texture.format, level.extent);
+    level.offset = align_up(packedSize, LEVEL_ALIGNMENT);
+
+    // written so the sum cant overflow
+    if (index.byteLength < level.size || index.byteOffset > raw.size() ||
+        level.size > raw.size() - index.byteOffset) {
+      fmt::println("KTX2 file {} has a broken level {}", filePath.string(), i);
+      return {};
+    }
+
+    texture.data.resize(level.offset + level.size);
+    memcpy(texture.data.data() + level.offset, raw.data() + index.byteOffset,
+           level.size);
+
+    packedSize = level.offset + level.size;
+    texture.levels.push_back(level);
+  }
+
+  return texture;
+}
+
+std::optional<TextureData> decodeTextureToRgba8(const TextureData &texture) {
+  CPU_ZONE("decode texture");
+  TextureData decoded;
+  decoded.format = is_srgb_format(texture.format) ? VK_FORMAT_R8G8B8A8_SRGB
+                                                  : VK_FORMAT_R8G8B8A8_UNORM;
+  decoded.extent = texture.extent;
+
+  vkutil::FormatBlock block = vkutil::format_block(texture.format);
+
+  for (const TextureLevel &level : texture.levels) {
+    TextureLevel out;
+    out.extent = level.extent;
+    out.offset = decoded.data.size();
+    out.size = vkutil::image_level_size(decoded.format, level.extent);
+    decoded.data.resize(out.offset + out.size);
+
+    Rgba8 *pixels = (Rgba8 *)(decoded.data.data() + out.offset);
+    const uint8_t *src = texture.data.data() + level.offset;
+
+    uint32_t blocksX = (level.extent.width + 3) / 4;
+    uint32_t blocksY = (level.extent.height + 3) / 4;
+    for (uint32_t by = 0; by < blocksY; by++) {
+      for (uint32_t bx = 0; bx < blocksX; bx++) {
+        Rgba8 texels[16];
+        if (!decode_bc_block(texture.format, src, texels)) {
+          return {};
+        }
+        src += block.bytes;
+
+        // edge blocks hang over the image on small mips
+        for (uint32_t y = 0; y < 4; y++) {
+          for (uint32_t x = 0; x < 4; x++) {
+            uint32_t px = bx * 4 + x;
+            uint32_t py = by * 4 + y;
+            if (px < level.extent.width && py < level.extent.height) {
+              pixels[py * level.extent.width + px] = texels[y * 4 + x];
+            }
+          }
+        }
+      }
+    }
+
+    decoded.levels.push_back(out);
+  }
+
+  return decoded;
+}
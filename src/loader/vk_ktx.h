@@ -0,0 +1,28 @@
+#pragma once
+
+#include <filesystem>
+#include <vk_types.h>
+
+struct TextureLevel {
+  // byte range of this level inside TextureData::data
+  size_t offset;
+  size_t size;
+  VkExtent3D extent;
+};
+
+// cpu side texture with all of its mip levels packed into one blob, ready to
+// be copied into a staging buffer
+struct TextureData {
+  VkFormat format;
+  VkExtent3D extent;
+  std::vector<TextureLevel> levels;
+  std::vector<uint8_t> data;
+};
+
+// loads a 2d, single layer KTX2 file without supercompression. Levels are kept
+// as stored, so block compressed files keep their prebuilt mips
+std::optional<TextureData> loadKtx2Texture(std::filesystem::path filePath);
+
+// cpu fallback for devices that cant sample the stored format. Handles
+// BC1/BC3/BC4/BC5 and returns nothing for everything else
+std::optional<TextureData> decodeTextureToRgba8(const TextureData &texture);
@@ -15,9 +15,133 @@
 
 #include <string.h>
 
+namespace {
+// the KTX2 file a texture samples, directly or through KHR_texture_basisu.
+// Other images are not loaded
+std::optional<std::filesystem::path>
+ktx2_texture_path(const fastgltf::Asset &gltf,
+                  const fastgltf::Optional<fastgltf::TextureInfo> &info,
+                  const std::filesystem::path &directory) {
+  if (!info) {
+    return {};
+  }
+  const fastgltf::Texture &texture = gltf.textures[info->textureIndex];
+  auto imageIndex = texture.basisuImageIndex ? texture.basisuImageIndex
+                                             : texture.imageIndex;
+  if (!imageIndex) {
+    return {};
+  }
+
+  const auto *uri =
+      std::get_if<fastgltf::sources::URI>(&gltf.images[*imageIndex].data);
+  if (!uri || !uri->uri.isLocalPath()) {
+    return {};
+  }
+  std::filesystem::path path = directory / uri->uri.fspath();
+  if (uri->mimeType != fastgltf::MimeType::KTX2 &&
+      path.extension() != ".ktx2") {
+    return {};
+  }
+  return path;
+}
+
+uint32_t load_streamed_texture(VulkanEngine *engine,
+                               std::optional<std::filesystem::path> path) {
+  if (!path) {
+    return TextureStreamer::INVALID_TEXTURE;
+  }
+  return engine->load_streamed_texture(*path).value_or(
+      TextureStreamer::INVALID_TEXTURE);
+}
+
+// keeps image for the material when it loads, destroyed with the engine
+void load_texture(VulkanEngine *engine,
+                  std::optional<std::filesystem::path> path,
+                  AllocatedImage &image) {
+  if (!path) {
+    return;
+  }
+  std::optional<AllocatedImage> loaded = engine->load_texture(*path);
+  if (loaded) {
+    image = *loaded;
+    engine->_mainDeletionQueue.push_function(
+        [=]() { engine->destroy_image(*loaded); });
+  }
+}
+
+// materials with a KTX2 texture, streamed unless streamTextures is off. The
+// others stay null and get the engine's default material
+std::vector<std::shared_ptr<GLTFMaterial>>
+load_materials(VulkanEngine *engine, const fastgltf::Asset &gltf,
+               const std::filesystem::path &directory) {
+  std::vector<std::shared_ptr<GLTFMaterial>> materials(gltf.materials.size());
+  if (gltf.materials.empty()) {
+    return materials;
+  }
+
+  // one uniform buffer holds the constants of every material in the file
+  using MaterialConstants = GLTFMetallic_Roughness::MaterialConstants;
+  AllocatedBuffer constantsBuffer = engine->create_buffer(
+      sizeof(MaterialConstants) * gltf.materials.size(),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  engine->_mainDeletionQueue.push_function(
+      [=]() { engine->destroy_buffer(constantsBuffer); });
+  MaterialConstants *constants =
+      (MaterialConstants *)constantsBuffer.info.pMappedData;
+
+  for (size_t i = 0; i < gltf.materials.size(); i++) {
+    const fastgltf::Material &mat = gltf.materials[i];
+    const fastgltf::PBRData &pbr = mat.pbrData;
+
+    constants[i].colorFactors =
+        glm::vec4(pbr.baseColorFactor[0], pbr.baseColorFactor[1],
+                  pbr.baseColorFactor[2], pbr.baseColorFactor[3]);
+    constants[i].metal_rough_factors =
+        glm::vec4(pbr.metallicFactor, pbr.roughnessFactor, 0, 0);
+
+    std::optional<std::filesystem::path> colorPath =
+        ktx2_texture_path(gltf, pbr.baseColorTexture, directory);
+    std::optional<std::filesystem::path> metalRoughPath =
+        ktx2_texture_path(gltf, pbr.metallicRoughnessTexture, directory);
+    if (!colorPath && !metalRoughPath) {
+      continue;
+    }
+
+    GLTFMetallic_Roughness::MaterialResources resources;
+    resources.colorImage = engine->_whiteImage;
+    resources.colorSampler = engine->_defaultSamplerLinear;
+    resources.metalRoughImage = engine->_whiteImage;
+    resources.metalRoughSampler = engine->_defaultSamplerLinear;
+    resources.dataBuffer = constantsBuffer.buffer;
+    resources.dataBufferOffset = (uint32_t)(i * sizeof(MaterialConstants));
+    resources.colorFactors = constants[i].colorFactors;
+    resources.metalRoughFactors = constants[i].metal_rough_factors;
+
+    MaterialPass pass = mat.alphaMode == fastgltf::AlphaMode::Blend
+                            ? MaterialPass::Transparent
+                            : MaterialPass::MainColor;
+
+    materials[i] = std::make_shared<GLTFMaterial>();
+    if (engine->streamTextures) {
+      engine->register_streamed_material(
+          &materials[i]->data, pass, resources,
+          load_streamed_texture(engine, colorPath),
+          load_streamed_texture(engine, metalRoughPath));
+    } else {
+      load_texture(engine, colorPath, resources.colorImage);
+      load_texture(engine, metalRoughPath, resources.metalRoughImage);
+      materials[i]->data = engine->metalRoughMaterial.write_material(
+          engine->_device, pass, resources, engine->globalDescriptorAllocator);
+    }
+  }
+  return materials;
+}
+} // namespace
+
 std::optional<std::vector<std::shared_ptr<MeshAsset>>>
 loadGltfMeshes(VulkanEngine *engine, std::filesystem::path filePath) {
   //> openmesh
+  CPU_ZONE("load gltf");
   std::cout << "Loading GLTF: " << filePath << std::endl;
 
   fastgltf::GltfDataBuffer data;
@@ -28,7 +152,7 @@ loadGltfMeshes(VulkanEngine *engine, std::filesystem::path filePath) {
                                fastgltf::Options::LoadExternalBuffers;
 
   fastgltf::Asset gltf;
-  fastgltf::Parser parser{};
+  fastgltf::Parser parser{fastgltf::Extensions::KHR_texture_basisu};
 
   auto load = parser.loadBinaryGLTF(&data, filePath.parent_path(), gltfOptions);
   if (load) {
@@ -39,6 +163,12 @@ loadGltfMeshes(VulkanEngine *engine, std::filesystem::path filePath) {
     return {};
   }
   //< openmesh
+  // every texture of the file goes up in one submit
+  engine->begin_image_uploads();
+  std::vector<std::shared_ptr<GLTFMaterial>> materials =
+      load_materials(engine, gltf, filePath.parent_path());
+  engine->end_image_uploads();
+
   //> loadmesh
   std::vector<std::shared_ptr<MeshAsset>> meshes;
 
@@ -60,6 +190,9 @@ loadGltfMeshes(VulkanEngine *engine, std::filesystem::path filePath) {
       newSurface.startIndex = (uint32_t)indices.size();
       newSurface.count =
           (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+      if (p.materialIndex) {
+        newSurface.material = materials[*p.materialIndex];
+      }
 
       size_t initial_vtx = vertices.size();
 
@@ -124,6 +257,17 @@ loadGltfMeshes(VulkanEngine *engine, std::filesystem::path filePath) {
               vertices[initial_vtx + index].color = v;
             });
       }
+      // loop the vertices of this surface, find min/max bounds
+      glm::vec3 minpos = vertices[initial_vtx].position;
+      glm::vec3 maxpos = vertices[initial_vtx].position;
+      for (size_t i = initial_vtx; i < vertices.size(); i++) {
+        minpos = glm::min(minpos, vertices[i].position);
+        maxpos = glm::max(maxpos, vertices[i].position);
+      }
+      newSurface.bounds.origin = (maxpos + minpos) / 2.f;
+      newSurface.bounds.extents = (maxpos - minpos) / 2.f;
+      newSurface.bounds.sphereRadius = glm::length(newSurface.bounds.extents);
+
       newmesh.surfaces.push_back(newSurface);
     }
 
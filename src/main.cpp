@@ -1,7 +1,71 @@
 #include "vk_engine.h"
 
+#include <cstdlib>
+#include <cstring>
+
+static bool parse_present_mode(const char *name, VkPresentModeKHR &mode) {
+  if (strcmp(name, "fifo") == 0) {
+    mode = VK_PRESENT_MODE_FIFO_KHR;
+  } else if (strcmp(name, "fifo_relaxed") == 0) {
+    mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+  } else if (strcmp(name, "mailbox") == 0) {
+    mode = VK_PRESENT_MODE_MAILBOX_KHR;
+  } else if (strcmp(name, "immediate") == 0) {
+    mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char *argv[]) {
   VulkanEngine engine;
+
+  // --headless [frames] renders offscreen, for machines without a display,
+  // --report <path> writes its results as json, --statistics adds pipeline
+  // statistics to the profiled passes and --trace [path] writes a cpu trace
+  // of the run. --replay <path> [loops] draws captured frames headless.
+  // --mesh <file.glb> loads another gltf, and
+  // --no-texture-streaming uploads its textures whole.
+  // --present-mode <fifo|fifo_relaxed|mailbox|immediate>,
+  // --frames-in-flight <n> and --frame-limit <fps> pick the starting present
+  // settings, so configurations can be compared run against run
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0) {
+      engine.headless = true;
+      if (i + 1 < argc && argv[i + 1][0] != '-') {
+        engine.headlessFrames = atoi(argv[++i]);
+      }
+    } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+      engine.headlessReport = argv[++i];
+    } else if (strcmp(argv[i], "--statistics") == 0) {
+      engine.usePipelineStatistics = true;
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      engine.headless = true;
+      engine.replayPath = argv[++i];
+      if (i + 1 < argc && argv[i + 1][0] != '-') {
+        engine.replayLoops = atoi(argv[++i]);
+      }
+    } else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+      engine.meshFiles.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--no-texture-streaming") == 0) {
+      engine.streamTextures = false;
+    } else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+      if (!parse_present_mode(argv[++i], engine.presentMode)) {
+        fmt::println("unknown present mode {}, keeping fifo", argv[i]);
+      }
+    } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+      engine.framesInFlight = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--frame-limit") == 0 && i + 1 < argc) {
+      engine.frameLimit = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "--trace") == 0) {
+      engine.headlessCpuTrace = true;
+      if (i + 1 < argc && argv[i + 1][0] != '-') {
+        engine.cpuTracePath = argv[++i];
+      }
+    }
+  }
+
   fmt::println("hello my friend\n");
   engine.init();
 
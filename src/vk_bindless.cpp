@@ -0,0 +1,206 @@
+#include "vk_bindless.h"
+
+#include "vk_engine.h"
+#include "vk_images.h"
+
+#include <algorithm>
+
+void BindlessResources::init(VulkanEngine *engine) {
+  _device = engine->_device;
+
+  VkDescriptorSetLayoutBinding bindings[2] = {};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = MAX_TEXTURES;
+  bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags =
+      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  // slots are written while frames that sample other slots are in flight,
+  // and most of the array is never written at all
+  VkDescriptorBindingFlags bindingFlags[2] = {
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+          VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT,
+      0};
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+      .bindingCount = 2,
+      .pBindingFlags = bindingFlags};
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .pNext = &flagsInfo,
+      .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+      .bindingCount = 2,
+      .pBindings = bindings};
+  VK_CHECK(vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_layout));
+
+  VkDescriptorPoolSize poolSizes[] = {
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_TEXTURES},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1}};
+  VkDescriptorPoolCreateInfo poolInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+      .maxSets = 1,
+      .poolSizeCount = (uint32_t)std::size(poolSizes),
+      .pPoolSizes = poolSizes};
+  VK_CHECK(vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_pool));
+
+  VkDescriptorSetAllocateInfo allocInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = _pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &_layout};
+  VK_CHECK(vkAllocateDescriptorSets(_device, &allocInfo, &_set));
+
+  // the table only changes through flush(), on the gpu timeline
+  _materialBuffer = engine->create_buffer(
+      MAX_MATERIALS * sizeof(GPUMaterialData),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+
+  VkDescriptorBufferInfo bufferInfo{.buffer = _materialBuffer.buffer,
+                                    .offset = 0,
+                                    .range = VK_WHOLE_SIZE};
+  VkWriteDescriptorSet write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                             .dstSet = _set,
+                             .dstBinding = 1,
+                             .descriptorCount = 1,
+                             .descriptorType =
+                                 VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                             .pBufferInfo = &bufferInfo};
+  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+}
+
+void BindlessResources::destroy(VulkanEngine *engine) {
+  engine->destroy_buffer(_materialBuffer);
+  vkDestroyDescriptorPool(_device, _pool, nullptr);
+  vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+
+  _textures.clear();
+  _textureLookup.clear();
+  _freeSlots.clear();
+  _releasedSlots.clear();
+  _materials.clear();
+}
+
+uint32_t BindlessResources::acquire_texture(VkImageView view,
+                                            VkSampler sampler) {
+  TextureKey key{view, sampler};
+  auto it = _textureLookup.find(key);
+  if (it != _textureLookup.end()) {
+    _textures[it->second].users++;
+    return it->second;
+  }
+
+  uint32_t slot;
+  if (!_freeSlots.empty()) {
+    slot = _freeSlots.back();
+    _freeSlots.pop_back();
+  } else if (_textures.size() < MAX_TEXTURES) {
+    slot = (uint32_t)_textures.size();
+    _textures.push_back({});
+  } else {
+    fmt::println("bindless texture array is full, {} slots", MAX_TEXTURES);
+    return 0;
+  }
+
+  _textures[slot] = TextureSlot{key, 1};
+  _textureLookup[key] = slot;
+
+  VkDescriptorImageInfo imageInfo{
+      .sampler = sampler,
+      .imageView = view,
+      .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  VkWriteDescriptorSet write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                             .dstSet = _set,
+                             .dstBinding = 0,
+                             .dstArrayElement = slot,
+                             .descriptorCount = 1,
+                             .descriptorType =
+                                 VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                             .pImageInfo = &imageInfo};
+  vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+  return slot;
+}
+
+void BindlessResources::release_texture(uint32_t slot, int frameNumber) {
+  TextureSlot &texture = _textures[slot];
+  if (--texture.users > 0) {
+    return;
+  }
+  _textureLookup.erase(texture.key);
+  _releasedSlots.push_back({slot, frameNumber});
+}
+
+uint32_t BindlessResources::add_material(const GPUMaterialData &material) {
+  if (_materials.size() >= MAX_MATERIALS) {
+    fmt::println("bindless material table is full, {} materials",
+                 MAX_MATERIALS);
+    return 0;
+  }
+  _materials.push_back(material);
+  update_material((uint32_t)_materials.size() - 1, material);
+  return (uint32_t)_materials.size() - 1;
+}
+
+void BindlessResources::update_material(uint32_t index,
+                                        const GPUMaterialData &material) {
+  _materials[index] = material;
+  if (_dirtyBegin == _dirtyEnd) {
+    _dirtyBegin = index;
+    _dirtyEnd = index + 1;
+  } else {
+    _dirtyBegin = std::min(_dirtyBegin, index);
+    _dirtyEnd = std::max(_dirtyEnd, index + 1);
+  }
+}
+
+void BindlessResources::collect(int completedFrame) {
+  auto done = [&](const ReleasedSlot &released) {
+    if (released.frameNumber > completedFrame) {
+      return false;
+    }
+    _freeSlots.push_back(released.slot);
+    return true;
+  };
+  _releasedSlots.erase(
+      std::remove_if(_releasedSlots.begin(), _releasedSlots.end(), done),
+      _releasedSlots.end());
+}
+
+void BindlessResources::flush(VkCommandBuffer cmd) {
+  if (_dirtyBegin == _dirtyEnd) {
+    return;
+  }
+
+  // earlier frames may still be reading the entries about to change
+  vkutil::memory_barrier(cmd,
+                         VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                         0, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                         VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+  // vkCmdUpdateBuffer takes at most 64 KiB per call
+  constexpr uint32_t MAX_UPDATE = 65536 / sizeof(GPUMaterialData);
+  for (uint32_t first = _dirtyBegin; first < _dirtyEnd; first += MAX_UPDATE) {
+    uint32_t count = std::min(MAX_UPDATE, _dirtyEnd - first);
+    vkCmdUpdateBuffer(cmd, _materialBuffer.buffer,
+                      first * sizeof(GPUMaterialData),
+                      count * sizeof(GPUMaterialData), &_materials[first]);
+  }
+
+  vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                         VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+  _dirtyBegin = 0;
+  _dirtyEnd = 0;
+}
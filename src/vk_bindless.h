@@ -0,0 +1,85 @@
+#pragma once
+#include "vk_types.h"
+
+#include <unordered_map>
+
+class VulkanEngine;
+
+//> bindless
+// One descriptor set shared by every bindless draw. It holds an update after
+// bind array with every material texture, and the table of every material,
+// indexed by the material index in the instance data. A draw that changes
+// material only changes an index, nothing gets bound. Texture slots stay
+// reserved until the frames that could still sample them are done, so a
+// written slot is never one a pending frame reads.
+struct BindlessResources {
+  static constexpr uint32_t MAX_TEXTURES = 16384;
+  static constexpr uint32_t MAX_MATERIALS = 8192;
+
+  void init(VulkanEngine *engine);
+  void destroy(VulkanEngine *engine);
+
+  // materials sharing a view and sampler share the slot
+  uint32_t acquire_texture(VkImageView view, VkSampler sampler);
+  // the slot is free for reuse once frameNumber has finished on the gpu
+  void release_texture(uint32_t slot, int frameNumber);
+
+  uint32_t add_material(const GPUMaterialData &material);
+  void update_material(uint32_t index, const GPUMaterialData &material);
+  const GPUMaterialData &material(uint32_t index) const {
+    return _materials[index];
+  }
+
+  // reclaims slots released by frames up to completedFrame
+  void collect(int completedFrame);
+  // copies the materials changed since the last flush into the table,
+  // ordered after earlier frames' reads and before this frame's
+  void flush(VkCommandBuffer cmd);
+
+  VkDescriptorSetLayout layout() const { return _layout; }
+  VkDescriptorSet set() const { return _set; }
+
+  uint32_t texture_count() const {
+    return (uint32_t)_textureLookup.size();
+  }
+  uint32_t material_count() const { return (uint32_t)_materials.size(); }
+
+private:
+  struct TextureKey {
+    VkImageView view;
+    VkSampler sampler;
+
+    bool operator==(const TextureKey &) const = default;
+  };
+  struct TextureKeyHash {
+    size_t operator()(const TextureKey &key) const {
+      return std::hash<uint64_t>()((uint64_t)key.view) ^
+             (std::hash<uint64_t>()((uint64_t)key.sampler) << 1);
+    }
+  };
+  struct TextureSlot {
+    TextureKey key;
+    uint32_t users;
+  };
+  struct ReleasedSlot {
+    uint32_t slot;
+    int frameNumber;
+  };
+
+  VkDevice _device;
+  VkDescriptorPool _pool;
+  VkDescriptorSetLayout _layout;
+  VkDescriptorSet _set;
+
+  std::vector<TextureSlot> _textures;
+  std::unordered_map<TextureKey, uint32_t, TextureKeyHash> _textureLookup;
+  std::vector<uint32_t> _freeSlots;
+  std::vector<ReleasedSlot> _releasedSlots;
+
+  AllocatedBuffer _materialBuffer;
+  // cpu copy of the table, [_dirtyBegin, _dirtyEnd) still has to be uploaded
+  std::vector<GPUMaterialData> _materials;
+  uint32_t _dirtyBegin{0};
+  uint32_t _dirtyEnd{0};
+};
+//< bindless
@@ -0,0 +1,163 @@
+#include "vk_command_recorder.h"
+#include "vk_descriptors.h"
+
+#include <cstring>
+
+void CommandRecorder::begin(VkCommandBuffer cmd) {
+  _cmd = cmd;
+  _pipeline = VK_NULL_HANDLE;
+  _layout = VK_NULL_HANDLE;
+  for (uint32_t i = 0; i < MAX_SETS; i++) {
+    _sets[i] = VK_NULL_HANDLE;
+    _pushed[i] = false;
+  }
+  _indexBuffer = VK_NULL_HANDLE;
+  _indexOffset = 0;
+  _indexType = VK_INDEX_TYPE_UINT32;
+  _pushSize = 0;
+}
+
+void CommandRecorder::bind_pipeline(VkPipeline pipeline) {
+  if (pipeline == _pipeline) {
+    _stats.pipelineBindsSkipped++;
+    return;
+  }
+  vkCmdBindPipeline(_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  _pipeline = pipeline;
+  _stats.pipelineBinds++;
+}
+
+void CommandRecorder::bind_descriptor_set(VkPipelineLayout layout,
+                                          uint32_t set,
+                                          VkDescriptorSet descriptorSet) {
+  use_layout(layout);
+  if (set < MAX_SETS && _sets[set] == descriptorSet) {
+    _stats.descriptorBindsSkipped++;
+    return;
+  }
+
+  vkCmdBindDescriptorSets(_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set,
+                          1, &descriptorSet, 0, nullptr);
+  if (set < MAX_SETS) {
+    _sets[set] = descriptorSet;
+    _pushed[set] = false;
+  }
+  _stats.descriptorBinds++;
+}
+
+void CommandRecorder::push_descriptor_set(VkPipelineLayout layout,
+                                          uint32_t set,
+                                          const DescriptorWriter &writer) {
+  use_layout(layout);
+  if (set < MAX_SETS && _pushed[set]) {
+    _stats.descriptorBindsSkipped++;
+    return;
+  }
+
+  writer.push_set(_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set);
+  if (set < MAX_SETS) {
+    _sets[set] = VK_NULL_HANDLE;
+    _pushed[set] = true;
+  }
+  _stats.descriptorBinds++;
+}
+
+void CommandRecorder::bind_index_buffer(VkBuffer buffer, VkDeviceSize offset,
+                                        VkIndexType indexType) {
+  if (buffer == _indexBuffer && offset == _indexOffset &&
+      indexType == _indexType) {
+    _stats.indexBufferBindsSkipped++;
+    return;
+  }
+  vkCmdBindIndexBuffer(_cmd, buffer, offset, indexType);
+  _indexBuffer = buffer;
+  _indexOffset = offset;
+  _indexType = indexType;
+  _stats.indexBufferBinds++;
+}
+
+void CommandRecorder::push_constants(VkPipelineLayout layout,
+                                     VkShaderStageFlags stages,
+                                     uint32_t offset, uint32_t size,
+                                     const void *data) {
+  use_layout(layout);
+  if (size <= MAX_PUSH_CONSTANT_SIZE && size == _pushSize &&
+      stages == _pushStages && offset == _pushOffset &&
+      memcmp(data, _pushData, size) == 0) {
+    _stats.pushConstantsSkipped++;
+    return;
+  }
+
+  vkCmdPushConstants(_cmd, layout, stages, offset, size, data);
+  if (size <= MAX_PUSH_CONSTANT_SIZE) {
+    _pushStages = stages;
+    _pushOffset = offset;
+    _pushSize = size;
+    memcpy(_pushData, data, size);
+  } else {
+    _pushSize = 0;
+  }
+  _stats.pushConstants++;
+}
+
+void CommandRecorder::draw(uint32_t vertexCount, uint32_t instanceCount,
+                           uint32_t firstVertex, uint32_t firstInstance) {
+  vkCmdDraw(_cmd, vertexCount, instanceCount, firstVertex, firstInstance);
+  _stats.draws++;
+  _stats.instances += instanceCount;
+}
+
+void CommandRecorder::draw_indexed(uint32_t indexCount, uint32_t instanceCount,
+                                   uint32_t firstIndex, int32_t vertexOffset,
+                                   uint32_t firstInstance) {
+  vkCmdDrawIndexed(_cmd, indexCount, instanceCount, firstIndex, vertexOffset,
+                   firstInstance);
+  _stats.draws++;
+  _stats.instances += instanceCount;
+}
+
+void CommandRecorder::draw_indexed_indirect(VkBuffer buffer,
+                                            VkDeviceSize offset,
+                                            uint32_t drawCount,
+                                            uint32_t stride) {
+  vkCmdDrawIndexedIndirect(_cmd, buffer, offset, drawCount, stride);
+  _stats.draws++;
+  _stats.indirectCommands += drawCount;
+}
+
+void CommandRecorder::draw_indexed_indirect_count(
+    VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer,
+    VkDeviceSize countOffset, uint32_t maxDrawCount, uint32_t stride) {
+  // the real number of commands is only known on the gpu
+  vkCmdDrawIndexedIndirectCount(_cmd, buffer, offset, countBuffer, countOffset,
+                                maxDrawCount, stride);
+  _stats.draws++;
+}
+
+void CommandRecorder::merge_stats(const RecorderStats &other) {
+  _stats.pipelineBinds += other.pipelineBinds;
+  _stats.pipelineBindsSkipped += other.pipelineBindsSkipped;
+  _stats.descriptorBinds += other.descriptorBinds;
+  _stats.descriptorBindsSkipped += other.descriptorBindsSkipped;
+  _stats.indexBufferBinds += other.indexBufferBinds;
+  _stats.indexBufferBindsSkipped += other.indexBufferBindsSkipped;
+  _stats.pushConstants += other.pushConstants;
+  _stats.pushConstantsSkipped += other.pushConstantsSkipped;
+  _stats.draws += other.draws;
+  _stats.instances += other.instances;
+  _stats.indirectCommands += other.indirectCommands;
+}
+
+void CommandRecorder::use_layout(VkPipelineLayout layout) {
+  if (layout == _layout) {
+    return;
+  }
+  // sets and push constants bound through another layout may be disturbed,
+  // assume the worst rather than checking layout compatibility
+  _layout = layout;
+  for (uint32_t i = 0; i < MAX_SETS; i++) {
+    _sets[i] = VK_NULL_HANDLE;
+    _pushed[i] = false;
+  }
+  _pushSize = 0;
+}
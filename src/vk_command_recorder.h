@@ -0,0 +1,89 @@
+#pragma once
+#include "vk_types.h"
+
+struct DescriptorWriter;
+
+//> command_recorder
+struct RecorderStats {
+  uint32_t pipelineBinds;
+  uint32_t pipelineBindsSkipped;
+  uint32_t descriptorBinds;
+  uint32_t descriptorBindsSkipped;
+  // pushes count as binds above, with push descriptors on
+  uint32_t indexBufferBinds;
+  uint32_t indexBufferBindsSkipped;
+  uint32_t pushConstants;
+  uint32_t pushConstantsSkipped;
+  uint32_t draws;
+  // instances over all direct draws
+  uint32_t instances;
+  // commands consumed by indirect draws
+  uint32_t indirectCommands;
+};
+
+// Thin layer over a graphics command buffer that remembers what is bound and
+// drops calls that would not change anything. It only knows about state that
+// went through it, so call begin() again after recording anything into cmd
+// directly.
+class CommandRecorder {
+public:
+  static constexpr uint32_t MAX_SETS = 4;
+  static constexpr uint32_t MAX_PUSH_CONSTANT_SIZE = 128;
+
+  // forgets the tracked state, stats keep counting until reset_stats()
+  void begin(VkCommandBuffer cmd);
+
+  void bind_pipeline(VkPipeline pipeline);
+  void bind_descriptor_set(VkPipelineLayout layout, uint32_t set,
+                           VkDescriptorSet descriptorSet);
+  // a pushed set is taken to stay the same for the whole recording, it is
+  // pushed again only after a layout change may have disturbed it
+  void push_descriptor_set(VkPipelineLayout layout, uint32_t set,
+                           const DescriptorWriter &writer);
+  void bind_index_buffer(VkBuffer buffer, VkDeviceSize offset,
+                         VkIndexType indexType);
+  void push_constants(VkPipelineLayout layout, VkShaderStageFlags stages,
+                      uint32_t offset, uint32_t size, const void *data);
+
+  void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex,
+            uint32_t firstInstance);
+  void draw_indexed(uint32_t indexCount, uint32_t instanceCount,
+                    uint32_t firstIndex, int32_t vertexOffset,
+                    uint32_t firstInstance);
+  void draw_indexed_indirect(VkBuffer buffer, VkDeviceSize offset,
+                             uint32_t drawCount, uint32_t stride);
+  void draw_indexed_indirect_count(VkBuffer buffer, VkDeviceSize offset,
+                                   VkBuffer countBuffer,
+                                   VkDeviceSize countOffset,
+                                   uint32_t maxDrawCount, uint32_t stride);
+
+  VkCommandBuffer command_buffer() const { return _cmd; }
+
+  const RecorderStats &stats() const { return _stats; }
+  void reset_stats() { _stats = {}; }
+  // adds the counters of a recorder that recorded another part of the frame
+  void merge_stats(const RecorderStats &other);
+
+private:
+  VkCommandBuffer _cmd{VK_NULL_HANDLE};
+
+  VkPipeline _pipeline;
+  // layout the descriptor sets and push constants were last set with
+  VkPipelineLayout _layout;
+  VkDescriptorSet _sets[MAX_SETS];
+  bool _pushed[MAX_SETS];
+
+  VkBuffer _indexBuffer;
+  VkDeviceSize _indexOffset;
+  VkIndexType _indexType;
+
+  VkShaderStageFlags _pushStages;
+  uint32_t _pushOffset;
+  uint32_t _pushSize;
+  uint8_t _pushData[MAX_PUSH_CONSTANT_SIZE];
+
+  RecorderStats _stats{};
+
+  void use_layout(VkPipelineLayout layout);
+};
+//< command_recorder
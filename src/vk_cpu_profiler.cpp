@@ -0,0 +1,148 @@
+#include "vk_cpu_profiler.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cpuprof {
+
+std::atomic<bool> detail::recording{false};
+
+namespace {
+// zones one thread can record in one capture, later ones are dropped
+constexpr uint32_t CAPACITY = 1 << 16;
+
+struct Event {
+  const char *name;
+  int64_t begin;
+  int64_t end;
+};
+
+// Only its own thread writes a buffer. The count is published after the
+// event it covers, so a reader never sees a half written event, and a buffer
+// last written in an older capture is emptied by its thread on first use.
+struct ThreadBuffer {
+  uint32_t tid;
+  const char *name;
+  std::atomic<uint32_t> generation{0};
+  std::atomic<uint32_t> count{0};
+  std::unique_ptr<Event[]> events;
+};
+
+// the lock is only taken once per thread, and by the export
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+std::atomic<uint32_t> generation{0};
+std::atomic<uint32_t> dropped{0};
+int64_t captureStart{0};
+
+thread_local ThreadBuffer *threadBuffer = nullptr;
+thread_local const char *threadName = nullptr;
+
+ThreadBuffer *thread_buffer() {
+  if (threadBuffer == nullptr) {
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->name = threadName;
+    buffer->events = std::make_unique<Event[]>(CAPACITY);
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer->tid = (uint32_t)threads.size();
+    threadBuffer = buffer.get();
+    threads.push_back(std::move(buffer));
+  }
+  return threadBuffer;
+}
+} // namespace
+
+void set_thread_name(const char *name) {
+  threadName = name;
+  if (threadBuffer != nullptr) {
+    threadBuffer->name = name;
+  }
+}
+
+void begin_capture() {
+  captureStart = detail::now_ns();
+  dropped = 0;
+  generation.fetch_add(1, std::memory_order_release);
+  detail::recording.store(true, std::memory_order_release);
+}
+
+void end_capture() {
+  detail::recording.store(false, std::memory_order_release);
+}
+
+bool capturing() {
+  return detail::recording.load(std::memory_order_relaxed);
+}
+
+void detail::record(const char *name, int64_t begin, int64_t end) {
+  ThreadBuffer *buffer = thread_buffer();
+  uint32_t current = generation.load(std::memory_order_acquire);
+  if (buffer->generation.load(std::memory_order_relaxed) != current) {
+    buffer->count.store(0, std::memory_order_relaxed);
+    buffer->generation.store(current, std::memory_order_release);
+  }
+
+  uint32_t index = buffer->count.load(std::memory_order_relaxed);
+  if (index == CAPACITY) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer->events[index] = {name, begin, end};
+  buffer->count.store(index + 1, std::memory_order_release);
+}
+
+bool write_chrome_trace(const std::string &path) {
+  std::ofstream file(path);
+  if (!file) {
+    fmt::println("could not write {}", path);
+    return false;
+  }
+
+  // times are in microseconds from the start of the capture
+  file << "{\"traceEvents\": [";
+  const char *separator = "\n";
+  size_t written = 0;
+  uint32_t current = generation.load(std::memory_order_acquire);
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  for (const std::unique_ptr<ThreadBuffer> &buffer : threads) {
+    if (buffer->generation.load(std::memory_order_acquire) != current) {
+      continue;
+    }
+    if (buffer->name != nullptr) {
+      file << fmt::format("{}{{\"name\": \"thread_name\", \"ph\": \"M\", "
+                          "\"pid\": 0, \"tid\": {}, \"args\": {{\"name\": "
+                          "\"{}\"}}}}",
+                          separator, buffer->tid, buffer->name);
+      separator = ",\n";
+    }
+
+    uint32_t count = buffer->count.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++) {
+      const Event &event = buffer->events[i];
+      // zones that began before the capture did are cut at its start
+      int64_t begin = std::max(event.begin, captureStart);
+      file << fmt::format("{}{{\"name\": \"{}\", \"ph\": \"X\", \"pid\": 0, "
+                          "\"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f}}}",
+                          separator, event.name, buffer->tid,
+                          (begin - captureStart) / 1000.0,
+                          (event.end - begin) / 1000.0);
+      separator = ",\n";
+    }
+    written += count;
+  }
+  file << "\n]}\n";
+
+  fmt::println("wrote {} cpu zones to {}, {} dropped", written, path,
+               dropped.load());
+  return true;
+}
+
+} // namespace cpuprof
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//> cpu_profiler
+// Scoped cpu zones, captured on demand and written out as a chrome trace for
+// chrome://tracing or ui.perfetto.dev. Every thread records into a buffer no
+// other thread writes, so recording a zone never takes a lock. Outside of a
+// capture a zone costs one relaxed atomic load, and building with
+// CPU_PROFILER_DISABLED removes them altogether.
+namespace cpuprof {
+
+// names the calling thread in the trace, a string literal
+void set_thread_name(const char *name);
+
+// drops what the last capture recorded and starts recording
+void begin_capture();
+void end_capture();
+bool capturing();
+
+// writes the last capture, call it once the capture has ended
+bool write_chrome_trace(const std::string &path);
+
+namespace detail {
+extern std::atomic<bool> recording;
+
+inline int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+void record(const char *name, int64_t begin, int64_t end);
+} // namespace detail
+
+// records the time until the end of the scope, name is a string literal
+class Scope {
+public:
+  explicit Scope(const char *name)
+      : _name(name),
+        _active(detail::recording.load(std::memory_order_relaxed)) {
+    if (_active) {
+      _begin = detail::now_ns();
+    }
+  }
+  ~Scope() {
+    if (_active) {
+      detail::record(_name, _begin, detail::now_ns());
+    }
+  }
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+private:
+  const char *_name;
+  bool _active;
+  int64_t _begin{0};
+};
+
+} // namespace cpuprof
+
+#define CPU_ZONE_JOIN2(a, b) a##b
+#define CPU_ZONE_JOIN(a, b) CPU_ZONE_JOIN2(a, b)
+#ifdef CPU_PROFILER_DISABLED
+#define CPU_ZONE(name)
+#else
+#define CPU_ZONE(name) cpuprof::Scope CPU_ZONE_JOIN(cpuZone, __LINE__)(name)
+#endif
+//< cpu_profiler
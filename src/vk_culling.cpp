@@ -0,0 +1,285 @@
+#include "vk_culling.h"
+
+#include "vk_jobs.h"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <random>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPUCULL_X64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang only emit AVX2 in functions that ask for it, so the rest of
+// the build keeps running on older cpus
+#if defined(__GNUC__) || defined(__clang__)
+#define CPUCULL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define CPUCULL_TARGET_AVX2
+#endif
+
+void cpucull::Bounds::resize(uint32_t count) {
+  uint32_t padded = (count + BATCH - 1) / BATCH * BATCH;
+  for (std::vector<float> *v : {&centerX, &centerY, &centerZ, &radius,
+                                &extentX, &extentY, &extentZ}) {
+    v->resize(padded);
+  }
+  // stale entries past count would otherwise keep their old bounds
+  for (uint32_t i = count; i < padded; i++) {
+    set(i, glm::vec3(0.f), 0.f, glm::vec3(0.f));
+  }
+}
+
+void cpucull::Bounds::set(uint32_t i, const glm::vec3 &center,
+                          float sphereRadius, const glm::vec3 &extents) {
+  centerX[i] = center.x;
+  centerY[i] = center.y;
+  centerZ[i] = center.z;
+  radius[i] = sphereRadius;
+  extentX[i] = extents.x;
+  extentY[i] = extents.y;
+  extentZ[i] = extents.z;
+}
+
+bool cpucull::has_avx2() {
+#ifdef CPUCULL_X64
+#ifdef _MSC_VER
+  static const bool supported = [] {
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+      return false;
+    }
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    // the os has to save the ymm registers on context switches
+    if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+      return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+  }();
+#else
+  static const bool supported =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+  return supported;
+#else
+  return false;
+#endif
+}
+
+namespace {
+void test_spheres_scalar(const Frustum &frustum, const cpucull::Bounds &b,
+                         uint32_t firstBatch, uint32_t endBatch,
+                         uint8_t *masks) {
+  for (uint32_t batch = firstBatch; batch < endBatch; batch++) {
+    uint8_t mask = 0;
+    for (uint32_t j = 0; j < cpucull::BATCH; j++) {
+      uint32_t i = batch * cpucull::BATCH + j;
+      bool inside = true;
+      for (const glm::vec4 &p : frustum.planes) {
+        float d = p.x * b.centerX[i] + p.y * b.centerY[i] +
+                  p.z * b.centerZ[i] + p.w;
+        inside &= d >= -b.radius[i];
+      }
+      mask |= uint8_t(inside) << j;
+    }
+    masks[batch] = mask;
+  }
+}
+
+void test_boxes_scalar(const Frustum &frustum, const cpucull::Bounds &b,
+                       uint32_t firstBatch, uint32_t endBatch,
+                       uint8_t *masks) {
+  for (uint32_t batch = firstBatch; batch < endBatch; batch++) {
+    uint8_t mask = 0;
+    for (uint32_t j = 0; j < cpucull::BATCH; j++) {
+      uint32_t i = batch * cpucull::BATCH + j;
+      bool inside = true;
+      for (const glm::vec4 &p : frustum.planes) {
+        float d = p.x * b.centerX[i] + p.y * b.centerY[i] +
+                  p.z * b.centerZ[i] + p.w;
+        // how far the box reaches along the plane normal
+        float r = std::abs(p.x) * b.extentX[i] + std::abs(p.y) * b.extentY[i] +
+                  std::abs(p.z) * b.extentZ[i];
+        inside &= d >= -r;
+      }
+      mask |= uint8_t(inside) << j;
+    }
+    masks[batch] = mask;
+  }
+}
+
+#ifdef CPUCULL_X64
+// signed distances of 8 centers to a plane
+CPUCULL_TARGET_AVX2 inline __m256 plane_distance(const glm::vec4 &p,
+                                                 __m256 cx, __m256 cy,
+                                                 __m256 cz) {
+  __m256 d = _mm256_fmadd_ps(cz, _mm256_set1_ps(p.z), _mm256_set1_ps(p.w));
+  d = _mm256_fmadd_ps(cy, _mm256_set1_ps(p.y), d);
+  return _mm256_fmadd_ps(cx, _mm256_set1_ps(p.x), d);
+}
+
+CPUCULL_TARGET_AVX2 void test_spheres_avx2(const Frustum &frustum,
+                                           const cpucull::Bounds &b,
+                                           uint32_t firstBatch,
+                                           uint32_t endBatch, uint8_t *masks) {
+  for (uint32_t batch = firstBatch; batch < endBatch; batch++) {
+    uint32_t i = batch * cpucull::BATCH;
+    __m256 cx = _mm256_loadu_ps(&b.centerX[i]);
+    __m256 cy = _mm256_loadu_ps(&b.centerY[i]);
+    __m256 cz = _mm256_loadu_ps(&b.centerZ[i]);
+    __m256 negRadius =
+        _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&b.radius[i]));
+
+    // lanes stay set while every plane has them on its inner side
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const glm::vec4 &p : frustum.planes) {
+      __m256 d = plane_distance(p, cx, cy, cz);
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negRadius, _CMP_GE_OQ));
+    }
+    masks[batch] = (uint8_t)_mm256_movemask_ps(inside);
+  }
+}
+
+CPUCULL_TARGET_AVX2 void test_boxes_avx2(const Frustum &frustum,
+                                         const cpucull::Bounds &b,
+                                         uint32_t firstBatch,
+                                         uint32_t endBatch, uint8_t *masks) {
+  // clearing the sign bit is abs()
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+  for (uint32_t batch = firstBatch; batch < endBatch; batch++) {
+    uint32_t i = batch * cpucull::BATCH;
+    __m256 cx = _mm256_loadu_ps(&b.centerX[i]);
+    __m256 cy = _mm256_loadu_ps(&b.centerY[i]);
+    __m256 cz = _mm256_loadu_ps(&b.centerZ[i]);
+    __m256 ex = _mm256_loadu_ps(&b.extentX[i]);
+    __m256 ey = _mm256_loadu_ps(&b.extentY[i]);
+    __m256 ez = _mm256_loadu_ps(&b.extentZ[i]);
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const glm::vec4 &p : frustum.planes) {
+      __m256 d = plane_distance(p, cx, cy, cz);
+
+      __m256 r = _mm256_mul_ps(
+          ez, _mm256_and_ps(_mm256_set1_ps(p.z), absMask));
+      r = _mm256_fmadd_ps(ey, _mm256_and_ps(_mm256_set1_ps(p.y), absMask), r);
+      r = _mm256_fmadd_ps(ex, _mm256_and_ps(_mm256_set1_ps(p.x), absMask), r);
+
+      // d >= -r, written as d + r >= 0
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r),
+                                                   _mm256_setzero_ps(),
+                                                   _CMP_GE_OQ));
+    }
+    masks[batch] = (uint8_t)_mm256_movemask_ps(inside);
+  }
+}
+#endif
+} // namespace
+
+void cpucull::test_spheres(const Frustum &frustum, const Bounds &bounds,
+                           uint32_t firstBatch, uint32_t endBatch,
+                           uint8_t *masks, bool allowAvx2) {
+#ifdef CPUCULL_X64
+  if (allowAvx2 && has_avx2()) {
+    test_spheres_avx2(frustum, bounds, firstBatch, endBatch, masks);
+    return;
+  }
+#endif
+  test_spheres_scalar(frustum, bounds, firstBatch, endBatch, masks);
+}
+
+void cpucull::test_boxes(const Frustum &frustum, const Bounds &bounds,
+                         uint32_t firstBatch, uint32_t endBatch,
+                         uint8_t *masks, bool allowAvx2) {
+#ifdef CPUCULL_X64
+  if (allowAvx2 && has_avx2()) {
+    test_boxes_avx2(frustum, bounds, firstBatch, endBatch, masks);
+    return;
+  }
+#endif
+  test_boxes_scalar(frustum, bounds, firstBatch, endBatch, masks);
+}
+
+cpucull::BenchmarkResult cpucull::run_benchmark(JobSystem &jobs,
+                                                uint32_t objectCount) {
+  // fixed seed so runs compare
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> position(-500.f, 500.f);
+  std::uniform_real_distribution<float> size(0.1f, 5.f);
+
+  Bounds bounds;
+  bounds.resize(objectCount);
+  for (uint32_t i = 0; i < objectCount; i++) {
+    glm::vec3 extents{size(rng), size(rng), size(rng)};
+    bounds.set(i, glm::vec3(position(rng), position(rng), position(rng)),
+               glm::length(extents), extents);
+  }
+
+  // a default camera in the middle of the cloud, looking down -z
+  Camera camera;
+  Frustum frustum = frustum_from_matrix(camera.get_projection_matrix(16.f / 9.f) *
+                                        camera.get_view_matrix());
+
+  uint32_t batches = bounds.batch_count();
+  std::vector<uint8_t> masks(batches);
+  std::vector<uint8_t> reference(batches);
+
+  auto measure = [&](auto &&cull) {
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+      auto start = std::chrono::high_resolution_clock::now();
+      cull();
+      auto end = std::chrono::high_resolution_clock::now();
+      best = std::min(
+          best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return (float)best;
+  };
+
+  BenchmarkResult result{};
+  result.objects = objectCount;
+  result.avx2 = has_avx2();
+
+  auto count_mismatches = [&] {
+    for (uint32_t i = 0; i < batches; i++) {
+      result.mismatches += std::popcount(uint8_t(masks[i] ^ reference[i]));
+    }
+  };
+
+  result.sphereScalar = measure([&] {
+    test_spheres(frustum, bounds, 0, batches, reference.data(), false);
+  });
+  result.sphereAvx2 = measure(
+      [&] { test_spheres(frustum, bounds, 0, batches, masks.data()); });
+  count_mismatches();
+
+  result.boxScalar = measure([&] {
+    test_boxes(frustum, bounds, 0, batches, reference.data(), false);
+  });
+  result.boxAvx2 =
+      measure([&] { test_boxes(frustum, bounds, 0, batches, masks.data()); });
+  count_mismatches();
+
+  result.boxParallel = measure([&] {
+    jobs.parallel_for(batches, 1024, [&](uint32_t begin, uint32_t end) {
+      test_boxes(frustum, bounds, begin, end, masks.data());
+    });
+  });
+  count_mismatches();
+
+  // padding objects are not part of the count
+  for (uint32_t i = 0; i < objectCount; i++) {
+    result.visible += (reference[i / BATCH] >> (i % BATCH)) & 1;
+  }
+  return result;
+}
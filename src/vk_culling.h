@@ -0,0 +1,68 @@
+#pragma once
+
+#include "camera.h"
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+//> cpu_culling
+// Frustum culling on the cpu, 8 objects at a time. Bounds are kept as
+// structure of arrays so a batch is one load per component, and the AVX2
+// path tests a whole batch against a plane in a few instructions. The
+// scalar path gives the same answers on cpus without AVX2.
+namespace cpucull {
+constexpr uint32_t BATCH = 8;
+
+// world space bounds, every array padded to a multiple of BATCH. Padding
+// entries are zero sized at the origin, callers ignore their result bits
+struct Bounds {
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radius;
+  std::vector<float> extentX;
+  std::vector<float> extentY;
+  std::vector<float> extentZ;
+
+  void resize(uint32_t count);
+  uint32_t batch_count() const { return (uint32_t)centerX.size() / BATCH; }
+
+  void set(uint32_t i, const glm::vec3 &center, float sphereRadius,
+           const glm::vec3 &extents);
+};
+
+// checked once, false on anything that is not x86-64
+bool has_avx2();
+
+// one byte per batch, bit i set when object i of the batch is inside or
+// touching the frustum. Only the batches in [firstBatch, endBatch) are
+// written, so ranges can be split over threads
+void test_spheres(const Frustum &frustum, const Bounds &bounds,
+                  uint32_t firstBatch, uint32_t endBatch, uint8_t *masks,
+                  bool allowAvx2 = true);
+void test_boxes(const Frustum &frustum, const Bounds &bounds,
+                uint32_t firstBatch, uint32_t endBatch, uint8_t *masks,
+                bool allowAvx2 = true);
+
+// milliseconds per pass over all objects, best of a few runs
+struct BenchmarkResult {
+  uint32_t objects;
+  uint32_t visible;
+  bool avx2;
+  // objects the avx2 and scalar paths disagree on. fma rounds differently,
+  // so only bounds that exactly touch a plane should ever show up here
+  uint32_t mismatches;
+  float sphereScalar;
+  float sphereAvx2;
+  float boxScalar;
+  float boxAvx2;
+  // boxes with the best path, split over the job system
+  float boxParallel;
+};
+
+// culls random bounds scattered around a camera with every path
+BenchmarkResult run_benchmark(JobSystem &jobs, uint32_t objectCount);
+} // namespace cpucull
+//< cpu_culling
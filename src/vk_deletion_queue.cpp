@@ -0,0 +1,98 @@
+#include "vk_deletion_queue.h"
+
+#include <limits>
+
+namespace {
+// entries are always pushed with a non decreasing frame number, so the
+// retired entries form a prefix of each vector. erase() on a prefix keeps the
+// capacity, which is what keeps the steady state allocation free
+template <typename T, typename F>
+void retire_entries(std::vector<DeferredDeletionQueue::Entry<T>> &entries,
+                    uint64_t completedFrame, F &&destroy) {
+  auto it = entries.begin();
+  for (; it != entries.end() && it->frame <= completedFrame; it++) {
+    destroy(it->handle);
+  }
+  entries.erase(entries.begin(), it);
+}
+} // namespace
+
+void DeferredDeletionQueue::push_buffer(const AllocatedBuffer &buffer,
+                                        uint64_t frame) {
+  buffers.push_back({buffer, frame});
+}
+
+void DeferredDeletionQueue::push_image(const AllocatedImage &image,
+                                       uint64_t frame) {
+  images.push_back({image, frame});
+}
+
+void DeferredDeletionQueue::push_image_view(VkImageView view, uint64_t frame) {
+  imageViews.push_back({view, frame});
+}
+
+void DeferredDeletionQueue::push_pipeline(VkPipeline pipeline,
+                                          uint64_t frame) {
+  pipelines.push_back({pipeline, frame});
+}
+
+void DeferredDeletionQueue::push_sampler(VkSampler sampler, uint64_t frame) {
+  samplers.push_back({sampler, frame});
+}
+
+void DeferredDeletionQueue::push_descriptor_pool(VkDescriptorPool pool,
+                                                 uint64_t frame) {
+  descriptorPools.push_back({pool, frame});
+}
+
+void DeferredDeletionQueue::push_allocation(VmaAllocation allocation,
+                                            uint64_t frame) {
+  allocations.push_back({allocation, frame});
+}
+
+void DeferredDeletionQueue::push_function(std::function<void()> &&function,
+                                          uint64_t frame) {
+  callbacks.push_back({std::move(function), frame});
+}
+
+void DeferredDeletionQueue::retire(VkDevice device, VmaAllocator allocator,
+                                   uint64_t completedFrame) {
+  // callbacks and views go first, they can reference the images and buffers
+  retire_entries(callbacks, completedFrame,
+                 [](std::function<void()> &f) { f(); });
+  retire_entries(imageViews, completedFrame, [&](VkImageView view) {
+    vkDestroyImageView(device, view, nullptr);
+  });
+  retire_entries(pipelines, completedFrame, [&](VkPipeline pipeline) {
+    vkDestroyPipeline(device, pipeline, nullptr);
+  });
+  retire_entries(samplers, completedFrame, [&](VkSampler sampler) {
+    vkDestroySampler(device, sampler, nullptr);
+  });
+  retire_entries(descriptorPools, completedFrame, [&](VkDescriptorPool pool) {
+    vkDestroyDescriptorPool(device, pool, nullptr);
+  });
+  retire_entries(images, completedFrame, [&](const AllocatedImage &image) {
+    if (image.imageView != VK_NULL_HANDLE) {
+      vkDestroyImageView(device, image.imageView, nullptr);
+    }
+    vmaDestroyImage(allocator, image.image, image.allocation);
+  });
+  retire_entries(buffers, completedFrame, [&](const AllocatedBuffer &buffer) {
+    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+  });
+  // after the images and buffers that may still be bound to it
+  retire_entries(allocations, completedFrame, [&](VmaAllocation allocation) {
+    vmaFreeMemory(allocator, allocation);
+  });
+}
+
+void DeferredDeletionQueue::flush(VkDevice device, VmaAllocator allocator) {
+  retire(device, allocator, std::numeric_limits<uint64_t>::max());
+}
+
+size_t DeferredDeletionQueue::size() const {
+  return buffers.size() + images.size() + imageViews.size() +
+         pipelines.size() + samplers.size() + descriptorPools.size() +
+         allocations.size() + callbacks.size();
+}
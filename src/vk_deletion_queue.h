@@ -0,0 +1,45 @@
+#pragma once
+#include "vk_types.h"
+
+//> deferred_deletion
+// Deferred destruction for objects that may still be in use by frames in
+// flight. Every handle is tagged with the frame number that last used it and
+// kept in a per-type vector, so once the vectors reach their working size
+// pushing and retiring never touch the heap.
+struct DeferredDeletionQueue {
+  template <typename T> struct Entry {
+    T handle;
+    uint64_t frame;
+  };
+
+  std::vector<Entry<AllocatedBuffer>> buffers;
+  std::vector<Entry<AllocatedImage>> images;
+  std::vector<Entry<VkImageView>> imageViews;
+  std::vector<Entry<VkPipeline>> pipelines;
+  std::vector<Entry<VkSampler>> samplers;
+  std::vector<Entry<VkDescriptorPool>> descriptorPools;
+  // memory that images or buffers were bound to without owning it
+  std::vector<Entry<VmaAllocation>> allocations;
+
+  // fallback for anything that has no typed queue. Capturing lambdas will
+  // allocate, so keep these out of the per-frame paths
+  std::vector<Entry<std::function<void()>>> callbacks;
+
+  void push_buffer(const AllocatedBuffer &buffer, uint64_t frame);
+  void push_image(const AllocatedImage &image, uint64_t frame);
+  void push_image_view(VkImageView view, uint64_t frame);
+  void push_pipeline(VkPipeline pipeline, uint64_t frame);
+  void push_sampler(VkSampler sampler, uint64_t frame);
+  void push_descriptor_pool(VkDescriptorPool pool, uint64_t frame);
+  void push_allocation(VmaAllocation allocation, uint64_t frame);
+  void push_function(std::function<void()> &&function, uint64_t frame);
+
+  // destroy everything whose last use was on or before completedFrame
+  void retire(VkDevice device, VmaAllocator allocator, uint64_t completedFrame);
+
+  // destroy everything, the gpu must be idle
+  void flush(VkDevice device, VmaAllocator allocator);
+
+  size_t size() const;
+};
+//< deferred_deletion
@@ -18,7 +18,7 @@ void DescriptorLayoutBuilder::clear()
 //< descriptor_bind
 
 //> descriptor_layout
-VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderStageFlags shaderStages)
+VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderStageFlags shaderStages, VkDescriptorSetLayoutCreateFlags flags)
 {
     for (auto& b : bindings) {
         b.stageFlags |= shaderStages;
@@ -29,7 +29,7 @@ VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderSt
 
     info.pBindings = bindings.data();
     info.bindingCount = (uint32_t)bindings.size();
-    info.flags = 0;
+    info.flags = flags;
 
     VkDescriptorSetLayout set;
     VK_CHECK(vkCreateDescriptorSetLayout(device, &info, nullptr, &set));
@@ -140,6 +140,15 @@ void DescriptorWriter::update_set(VkDevice device, VkDescriptorSet set)
 
     vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
 }
+
+PFN_vkCmdPushDescriptorSetKHR DescriptorWriter::cmdPushDescriptorSet = nullptr;
+
+void DescriptorWriter::push_set(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set) const
+{
+    // dstSet is ignored for pushes, so the same writer can be pushed from
+    // several threads at once
+    cmdPushDescriptorSet(cmd, bindPoint, layout, set, (uint32_t)writes.size(), writes.data());
+}
 //< writer_end
 //> growpool_2
 void DescriptorAllocatorGrowable::init(VkDevice device, uint32_t maxSets, std::span<PoolSizeRatio> poolRatios)
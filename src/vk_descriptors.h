@@ -9,7 +9,8 @@ struct DescriptorLayoutBuilder {
 
   void add_binding(uint32_t binding, VkDescriptorType type);
   void clear();
-  VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shaderStages);
+  VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shaderStages,
+                              VkDescriptorSetLayoutCreateFlags flags = 0);
 };
 //< descriptor_layout
 //
@@ -26,6 +27,14 @@ struct DescriptorWriter {
 
   void clear();
   void update_set(VkDevice device, VkDescriptorSet set);
+  // records the writes straight into cmd, set has to be a layout built with
+  // VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+  void push_set(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint,
+                VkPipelineLayout layout, uint32_t set) const;
+
+  // VK_KHR_push_descriptor is not exported by the loader, the engine fills
+  // this in when the device has it
+  static PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSet;
 };
 //< writer
 //
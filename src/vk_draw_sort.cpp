@@ -0,0 +1,95 @@
+#include "vk_draw_sort.h"
+
+#include "vk_jobs.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+
+namespace {
+constexpr uint32_t RADIX_BITS = 8;
+constexpr uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+
+// below this the whole sort runs on the calling thread
+constexpr uint32_t PARALLEL_THRESHOLD = 4096;
+// histograms live on the stack, so the sort is split into at most this many
+// chunks whatever the thread count
+constexpr uint32_t MAX_CHUNKS = 16;
+
+using Histogram = std::array<uint32_t, RADIX_SIZE>;
+} // namespace
+
+uint32_t drawkey::depth_bucket(float viewDistance, float maxDistance) {
+  float d = std::clamp(viewDistance, 0.f, maxDistance);
+  float t = std::log2(1.f + d) / std::log2(1.f + maxDistance);
+  return (uint32_t)(t * float((1u << DEPTH_BITS) - 1));
+}
+
+void radix_sort_draws(std::vector<DrawSortEntry> &entries,
+                      std::vector<DrawSortEntry> &scratch, JobSystem &jobs) {
+  uint32_t count = (uint32_t)entries.size();
+  if (count < 2) {
+    return;
+  }
+  scratch.resize(count);
+
+  uint32_t chunkCount = 1;
+  if (count >= PARALLEL_THRESHOLD) {
+    chunkCount = std::min(jobs.thread_count(), MAX_CHUNKS);
+  }
+  uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+  chunkCount = (count + chunkSize - 1) / chunkSize;
+
+  // one histogram per chunk, per pass
+  std::array<Histogram, MAX_CHUNKS> chunkHistograms;
+  std::span<Histogram> histograms(chunkHistograms.data(), chunkCount);
+
+  DrawSortEntry *src = entries.data();
+  DrawSortEntry *dst = scratch.data();
+
+  for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS) {
+    jobs.parallel_for(count, chunkSize, [&](uint32_t begin, uint32_t end) {
+      Histogram &histogram = histograms[begin / chunkSize];
+      histogram.fill(0);
+      for (uint32_t i = begin; i < end; i++) {
+        histogram[(src[i].key >> shift) & (RADIX_SIZE - 1)]++;
+      }
+    });
+
+    // turn the counts into scatter offsets: every digit starts after all
+    // smaller digits, and within a digit chunk order keeps the sort stable
+    uint32_t offset = 0;
+    bool trivial = false;
+    for (uint32_t digit = 0; digit < RADIX_SIZE; digit++) {
+      uint32_t digitTotal = 0;
+      for (Histogram &histogram : histograms) {
+        uint32_t n = histogram[digit];
+        histogram[digit] = offset + digitTotal;
+        digitTotal += n;
+      }
+      if (digitTotal == count) {
+        trivial = true;
+        break;
+      }
+      offset += digitTotal;
+    }
+    if (trivial) {
+      continue;
+    }
+
+    jobs.parallel_for(count, chunkSize, [&](uint32_t begin, uint32_t end) {
+      Histogram &histogram = histograms[begin / chunkSize];
+      for (uint32_t i = begin; i < end; i++) {
+        uint32_t digit = (src[i].key >> shift) & (RADIX_SIZE - 1);
+        dst[histogram[digit]++] = src[i];
+      }
+    });
+
+    std::swap(src, dst);
+  }
+
+  if (src != entries.data()) {
+    std::copy(src, src + count, entries.data());
+  }
+}
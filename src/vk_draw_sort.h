@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class JobSystem;
+
+//> draw_sort
+// 64 bit draw key, most significant field first. Sorting by it groups draws
+// by the state they bind, and draws of the same surface end up next to each
+// other so they can be instanced. The depth bucket only orders draws that
+// share all of it.
+//   63..62 pass
+//   61..54 pipeline
+//   53..40 material set
+//   39..26 index buffer
+//   25..16 surface
+//   15..0  depth bucket
+namespace drawkey {
+constexpr uint32_t PASS_BITS = 2;
+constexpr uint32_t PIPELINE_BITS = 8;
+constexpr uint32_t MATERIAL_BITS = 14;
+constexpr uint32_t INDEX_BUFFER_BITS = 14;
+constexpr uint32_t SURFACE_BITS = 10;
+constexpr uint32_t DEPTH_BITS = 16;
+
+constexpr uint64_t field(uint32_t value, uint32_t bits, uint32_t shift) {
+  return uint64_t(value & ((1u << bits) - 1)) << shift;
+}
+
+constexpr uint64_t make(uint32_t pass, uint32_t pipeline, uint32_t material,
+                        uint32_t indexBuffer, uint32_t surface,
+                        uint32_t depth) {
+  // ids past the field width wrap around, that only costs some grouping
+  return field(pass, PASS_BITS, 62) | field(pipeline, PIPELINE_BITS, 54) |
+         field(material, MATERIAL_BITS, 40) |
+         field(indexBuffer, INDEX_BUFFER_BITS, 26) |
+         field(surface, SURFACE_BITS, 16) | field(depth, DEPTH_BITS, 0);
+}
+
+// view distance to a bucket. Logarithmic, so nearby draws that matter most
+// for early depth rejection get the finest buckets
+uint32_t depth_bucket(float viewDistance, float maxDistance);
+} // namespace drawkey
+
+// small ids for vulkan handles so they fit in a key field. Ids stay the same
+// across frames, so the map stops growing once every handle has been seen
+struct SortKeyIds {
+  std::unordered_map<uint64_t, uint32_t> ids;
+
+  uint32_t get(uint64_t handle) {
+    auto [it, inserted] = ids.try_emplace(handle, (uint32_t)ids.size());
+    return it->second;
+  }
+};
+
+struct DrawSortEntry {
+  uint64_t key;
+  uint32_t index;
+};
+
+// stable LSD radix sort on the key, 8 bits per pass. Histograms and scatter
+// are split over the job system, passes where every key has the same digit
+// are skipped, which is most of them for typical scenes. scratch is resized
+// as needed and kept by the caller so the steady state does not allocate
+void radix_sort_draws(std::vector<DrawSortEntry> &entries,
+                      std::vector<DrawSortEntry> &scratch, JobSystem &jobs);
+//< draw_sort
@@ -0,0 +1,56 @@
+#include "vk_dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// weight of the newest frame in the smoothed time
+constexpr float SMOOTHING = 0.1f;
+// largest change of the scale in one step, big jumps are visible
+constexpr float MAX_STEP = 0.1f;
+// scales are kept on this grid so tiny corrections do not thrash
+constexpr float GRANULARITY = 0.025f;
+} // namespace
+
+float DynamicResolution::update(float gpuMs, float scale) {
+  if (gpuMs <= 0.f) {
+    return scale;
+  }
+
+  if (_smoothedMs <= 0.f) {
+    _smoothedMs = gpuMs;
+  } else {
+    _smoothedMs += (gpuMs - _smoothedMs) * SMOOTHING;
+  }
+
+  if (_hold > 0) {
+    _hold--;
+    return scale;
+  }
+
+  float low = targetMs * (1.f - band);
+  float high = targetMs * (1.f + band);
+  if (_smoothedMs >= low && _smoothedMs <= high) {
+    return std::clamp(scale, minScale, maxScale);
+  }
+
+  // the cost goes with the pixel count, so with the square of the scale
+  float wanted = scale * std::sqrt(targetMs / _smoothedMs);
+  wanted = std::clamp(wanted, scale - MAX_STEP, scale + MAX_STEP);
+  wanted = std::round(wanted / GRANULARITY) * GRANULARITY;
+  wanted = std::clamp(wanted, minScale, maxScale);
+  if (wanted == scale) {
+    return scale;
+  }
+
+  // predict the time at the new scale so the average does not have to
+  // climb back from the old one
+  _smoothedMs *= (wanted * wanted) / (scale * scale);
+  _hold = holdFrames;
+  return wanted;
+}
+
+void DynamicResolution::reset() {
+  _smoothedMs = 0.f;
+  _hold = 0;
+}
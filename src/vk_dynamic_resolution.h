@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+//> dynamic_resolution
+// Steers the render scale toward a gpu time budget. The measured times are
+// smoothed, and nothing changes while they stay within the band around the
+// target, so noise alone never moves the scale. A change assumes the cost
+// follows the pixel count, and is followed by a few frames without changes
+// so the new scale shows up in the measurements before the next one.
+struct DynamicResolution {
+  float targetMs = 16.6f;
+  float minScale = 0.5f;
+  float maxScale = 1.f;
+  // half width of the dead band, as a fraction of the target
+  float band = 0.1f;
+  // frames to hold the scale after a change
+  uint32_t holdFrames = 8;
+
+  // feeds the gpu time of a frame rendered at scale, returns the scale the
+  // next frame should use
+  float update(float gpuMs, float scale);
+  // forgets the history, for when the measurements stop being comparable
+  void reset();
+
+  float smoothed_ms() const { return _smoothedMs; }
+
+private:
+  float _smoothedMs{0.f};
+  uint32_t _hold{0};
+};
+//< dynamic_resolution
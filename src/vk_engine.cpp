@@ -1,6 +1,8 @@
 ﻿#define GLM_ENABLE_EXPERIMENTAL
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -27,6 +29,7 @@
 #include "imgui.h"
 #include "imgui_impl_sdl2.h"
 #include "imgui_impl_vulkan.h"
+#include <glm/common.hpp>
 #include <glm/gtx/transform.hpp>
 
 #include "meshes.h"
@@ -42,15 +45,57 @@ constexpr bool bUseValidationLayers = true;
 // would give an error message to the user, or perform a dump of state.
 using namespace std;
 
+// milliseconds since start, for the cpu timings in EngineStats
+static float elapsed_ms(std::chrono::system_clock::time_point start) {
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now() - start);
+  return elapsed.count() / 1000.f;
+}
+
+static const char *present_mode_name(VkPresentModeKHR mode) {
+  switch (mode) {
+  case VK_PRESENT_MODE_IMMEDIATE_KHR:
+    return "immediate";
+  case VK_PRESENT_MODE_MAILBOX_KHR:
+    return "mailbox";
+  case VK_PRESENT_MODE_FIFO_KHR:
+    return "fifo";
+  case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+    return "fifo relaxed";
+  default:
+    return "other";
+  }
+}
+
 void VulkanEngine::init() {
   // We initialize SDL and create a window with it.
-  SDL_Init(SDL_INIT_VIDEO);
+  if (!headless) {
+    SDL_Init(SDL_INIT_VIDEO);
 
-  SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+    SDL_WindowFlags window_flags =
+        (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
 
-  _window = SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_UNDEFINED,
-                             SDL_WINDOWPOS_UNDEFINED, _windowExtent.width,
-                             _windowExtent.height, window_flags);
+    _window = SDL_CreateWindow("Vulkan Engine", SDL_WINDOWPOS_UNDEFINED,
+                               SDL_WINDOWPOS_UNDEFINED, _windowExtent.width,
+                               _windowExtent.height, window_flags);
+  }
+
+  cpuprof::set_thread_name("main");
+  _jobs.init();
+  recordThreads =
+      std::min<int>(_jobs.thread_count(), (int)MAX_RECORD_THREADS);
+  framesInFlight = std::clamp(framesInFlight, 1, (int)FRAME_OVERLAP);
+  _framesInFlight = framesInFlight;
+
+  // a replay renders at the size it was captured at, so the capture is read
+  // before the draw image is made
+  if (headless && !replayPath.empty() && _frameCapture.read(replayPath) &&
+      _frameCapture.frame_count() > 0) {
+    _replaying = true;
+    _windowExtent = _frameCapture.extent();
+    renderScale = _frameCapture.render_scale();
+    useDynamicResolution = false;
+  }
 
   init_vulkan();
 
@@ -64,10 +109,24 @@ void VulkanEngine::init() {
 
   init_pipelines();
 
-  init_imgui();
+  if (!headless) {
+    init_imgui();
+  }
 
   init_default_data();
 
+  if (_replaying) {
+    if (_frameCapture.resolve(testMeshes)) {
+      headlessFrames =
+          _frameCapture.frame_count() * std::max(replayLoops, 1);
+    } else {
+      fmt::println("not replaying {}, drawing the usual scene", replayPath);
+      _replaying = false;
+    }
+  }
+
+  mainCamera.position = glm::vec3(0.f, 0.f, 5.f);
+
   // everything went fine
   _isInitialized = true;
 }
@@ -108,6 +167,9 @@ void VulkanEngine::init_default_data() {
                          std::span{Suzanne_vtx, Suzanne_vtx_count});
 
   //> default_img
+  // upload all the default textures with a single submit
+  begin_image_uploads();
+
   // 3 default textures, white, grey, black. 1 pixel each
   uint32_t white = 0xFFFFFFFF;
   _whiteImage =
@@ -136,15 +198,23 @@ void VulkanEngine::init_default_data() {
       create_image(pixels.data(), VkExtent3D{16, 16, 1},
                    VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
 
+  end_image_uploads();
+
   VkSamplerCreateInfo sampl = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
 
+  // let the samplers reach the whole mip chain, maxLod defaults to 0
+  sampl.minLod = 0.f;
+  sampl.maxLod = VK_LOD_CLAMP_NONE;
+
   sampl.magFilter = VK_FILTER_NEAREST;
   sampl.minFilter = VK_FILTER_NEAREST;
+  sampl.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
 
   vkCreateSampler(_device, &sampl, nullptr, &_defaultSamplerNearest);
 
   sampl.magFilter = VK_FILTER_LINEAR;
   sampl.minFilter = VK_FILTER_LINEAR;
+  sampl.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   vkCreateSampler(_device, &sampl, nullptr, &_defaultSamplerLinear);
   //< default_img
 
@@ -167,6 +237,8 @@ void VulkanEngine::init_default_data() {
           materialConstants.allocation->GetMappedData();
   sceneUniformData->colorFactors = glm::vec4{1, 1, 1, 1};
   sceneUniformData->metal_rough_factors = glm::vec4{1, 0.5, 0, 0};
+  materialResources.colorFactors = sceneUniformData->colorFactors;
+  materialResources.metalRoughFactors = sceneUniformData->metal_rough_factors;
 
   _mainDeletionQueue.push_function(
       [=, this]() { destroy_buffer(materialConstants); });
@@ -182,7 +254,17 @@ void VulkanEngine::init_default_data() {
   auto full_path =
       std::string(PROJECT_ROOT_PATH) + "/" + "assets/basicmesh.glb";
 
+  // the textures of every file go up in one submit
+  begin_image_uploads();
   testMeshes = loadGltfMeshes(this, full_path).value();
+  for (const std::string &file : meshFiles) {
+    std::optional<std::vector<std::shared_ptr<MeshAsset>>> meshes =
+        loadGltfMeshes(this, file);
+    if (meshes) {
+      testMeshes.insert(testMeshes.end(), meshes->begin(), meshes->end());
+    }
+  }
+  end_image_uploads();
 
   //> default_meshes
   for (auto &m : testMeshes) {
@@ -192,8 +274,11 @@ void VulkanEngine::init_default_data() {
     newNode->localTransform = glm::mat4{1.f};
     newNode->worldTransform = glm::mat4{1.f};
 
+    // surfaces without a material of their own from the file
     for (auto &s : newNode->mesh->surfaces) {
-      s.material = std::make_shared<GLTFMaterial>(defaultData);
+      if (!s.material) {
+        s.material = std::make_shared<GLTFMaterial>(defaultData);
+      }
     }
 
     loadedNodes[m->name] = std::move(newNode);
@@ -205,37 +290,64 @@ void VulkanEngine::cleanup() {
 
     // make sure the gpu has stopped doing its things
     vkDeviceWaitIdle(_device);
-    for (auto &frame : _frames) {
+
+    _textureStreamer.destroy(this);
+    if (_bindlessMaterials) {
+      _bindless.destroy(this);
+    }
+    _gpuProfiler.destroy(_device);
+    _renderTargets.destroy(this);
+    for (VkImageView view : _depthPyramidMips) {
+      _frameDeletionQueue.push_image_view(view, _frameNumber);
     }
+    if (_visibilityBuffer.buffer != VK_NULL_HANDLE) {
+      _frameDeletionQueue.push_buffer(_visibilityBuffer, _frameNumber);
+    }
+    for (int i = 0; i < FRAME_OVERLAP; i++) {
+      FrameData &frame = _frames[i];
+      for (AllocatedBuffer *buffer :
+           {&frame._sceneDataBuffer, &frame._instanceBuffer,
+            &frame._indirectBuffer, &frame._cullObjectBuffer,
+            &frame._culledDrawBuffer, &frame._drawCountBuffer,
+            &frame._cullStatsBuffer}) {
+        if (buffer->buffer != VK_NULL_HANDLE) {
+          _frameDeletionQueue.push_buffer(*buffer, _frameNumber);
+        }
+      }
+    }
+
+    // the frame queue still needs the allocator, so it goes before the main
+    // queue destroys it
+    _frameDeletionQueue.flush(_device, _allocator);
 
     _mainDeletionQueue.flush();
     for (int i = 0; i < FRAME_OVERLAP; i++) {
 
       vkDestroyCommandPool(_device, _frames[i]._commandPool, nullptr);
+      for (RecordSlot &slot : _frames[i]._recordSlots) {
+        vkDestroyCommandPool(_device, slot.pool, nullptr);
+      }
 
       // destroy sync objects
       vkDestroyFence(_device, _frames[i]._renderFence, nullptr);
       vkDestroySemaphore(_device, _frames[i]._renderSemaphore, nullptr);
       vkDestroySemaphore(_device, _frames[i]._swapchainSemaphore, nullptr);
-
-      _frames[i]._deletionQueue.flush();
     }
 
-    vkDestroySwapchainKHR(_device, _swapchain, nullptr);
-
-    // destroy swapchain resources
-    for (int i = 0; i < _swapchainImageViews.size(); i++) {
-
-      vkDestroyImageView(_device, _swapchainImageViews[i], nullptr);
+    if (!headless) {
+      destroy_swapchain();
+      vkDestroySurfaceKHR(_instance, _surface, nullptr);
     }
 
-    vkDestroySurfaceKHR(_instance, _surface, nullptr);
-
     vkDestroyDevice(_device, nullptr);
     vkb::destroy_debug_utils_messenger(_instance, _debug_messenger);
     vkDestroyInstance(_instance, nullptr);
 
-    SDL_DestroyWindow(_window);
+    if (!headless) {
+      SDL_DestroyWindow(_window);
+    }
+
+    _jobs.shutdown();
   }
 }
 
@@ -246,9 +358,24 @@ void VulkanEngine::draw_background(VkCommandBuffer cmd) {
   vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
 
   // bind the descriptor set containing the draw image for the compute pipeline
-  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          _gradientPipelineLayout, 0, 1, &_drawImageDescriptors,
-                          0, nullptr);
+  DescriptorWriter writer;
+  writer.write_image(0, _drawImage.imageView, VK_NULL_HANDLE,
+                     VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  if (_pushDescriptors) {
+    writer.push_set(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    _gradientPipelineLayout, 0);
+  } else {
+    // this slot's fence has signaled, so its set is no longer in use and can
+    // be rewritten while the other slots keep the old draw image
+    FrameData &frame = get_current_frame();
+    if (frame._drawImageSetVersion != _drawImageVersion) {
+      writer.update_set(_device, frame._drawImageSet);
+      frame._drawImageSetVersion = _drawImageVersion;
+    }
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            _gradientPipelineLayout, 0, 1, &frame._drawImageSet,
+                            0, nullptr);
+  }
 
   vkCmdPushConstants(cmd, _gradientPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
                      0, sizeof(ComputePushConstants), &effect.data);
@@ -259,88 +386,1108 @@ void VulkanEngine::draw_background(VkCommandBuffer cmd) {
 }
 
 void VulkanEngine::draw_geometry(VkCommandBuffer cmd) {
+  CPU_ZONE("draw geometry");
+  auto start = std::chrono::system_clock::now();
+
+  // the frame's own uniform buffer, its last reader finished with the fence
+  const AllocatedBuffer &gpuSceneDataBuffer =
+      get_current_frame()._sceneDataBuffer;
+  GPUSceneData *sceneUniformData =
+      (GPUSceneData *)gpuSceneDataBuffer.allocation->GetMappedData();
+  *sceneUniformData = sceneData;
+
+  // create a descriptor set that binds that buffer and update it. With push
+  // descriptors there is no set, every command buffer that draws pushes the
+  // writes itself
+  auto descriptorStart = std::chrono::system_clock::now();
+  DescriptorWriter sceneWriter;
+  sceneWriter.write_buffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData),
+                           0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+  VkDescriptorSet globalDescriptor = VK_NULL_HANDLE;
+  if (!_pushDescriptors) {
+    globalDescriptor = get_current_frame()._frameDescriptors.allocate(
+        _device, _gpuSceneDataDescriptorLayout);
+    sceneWriter.update_set(_device, globalDescriptor);
+  }
+  stats.descriptorTime += elapsed_ms(descriptorStart);
+
+  sort_draws();
+
+  GPUInstancedPushConstants pushConstants;
+  pushConstants.instanceBuffer = build_draw_batches();
+
+  // the cull pass writes the indirect commands, so it runs before rendering
+  bool occlusion = useGpuCulling && useOcclusionCulling;
+  if (useGpuCulling) {
+    cull_draws(cmd, occlusion ? CULL_EARLY : CULL_SINGLE);
+  }
+
   // begin a render pass  connected to our draw image
   VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(
       _drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_GENERAL);
   VkRenderingAttachmentInfo depthAttachment = vkinit::depth_attachment_info(
       _depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 
-  VkRenderingInfo renderInfo =
-      vkinit::rendering_info(_drawExtent, &colorAttachment, &depthAttachment);
-  vkCmdBeginRendering(cmd, &renderInfo);
+  const std::vector<RenderObject> &draws = mainDrawContext.OpaqueSurfaces;
+  FrameData &frame = get_current_frame();
+  bool prepass = useDepthPrepass;
+
+  // everything in the pass goes through a recorder so repeated binds of the
+  // same state are dropped. Chunks may record on different threads, each
+  // with its own recorder
+  auto bind_scene = [&](CommandRecorder &rec, VkPipelineLayout layout) {
+    if (_pushDescriptors) {
+      rec.push_descriptor_set(layout, 0, sceneWriter);
+    } else {
+      rec.bind_descriptor_set(layout, 0, globalDescriptor);
+    }
+  };
+  auto bind_state = [&](CommandRecorder &rec, const RenderObject &draw,
+                        bool depthOnly) {
+    // bindless materials all bind the same set, the recorder drops the
+    // repeats
+    const MaterialPipeline *material = useBindless
+                                           ? draw.material->bindlessPipeline
+                                           : draw.material->pipeline;
+    VkDescriptorSet materialSet =
+        useBindless ? _bindless.set() : draw.material->materialSet;
+
+    VkPipelineLayout layout = material->layout;
+    if (depthOnly) {
+      layout = _depthPrepassPipelineLayout;
+      rec.bind_pipeline(_depthPrepassPipeline);
+      bind_scene(rec, layout);
+    } else {
+      VkPipeline pipeline = material->pipeline;
+      if (prepass && material->depthEqualPipeline) {
+        pipeline = material->depthEqualPipeline;
+      }
+      rec.bind_pipeline(pipeline);
+      bind_scene(rec, layout);
+      rec.bind_descriptor_set(layout, 1, materialSet);
+    }
+
+    rec.bind_index_buffer(draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _trianglePipeline);
+    rec.push_constants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(GPUInstancedPushConstants), &pushConstants);
+  };
 
-  // set dynamic viewport and scissor
-  VkViewport viewport = {};
-  viewport.x = 0;
-  viewport.y = 0;
-  viewport.width = _drawExtent.width;
-  viewport.height = _drawExtent.height;
-  viewport.minDepth = 0.f;
-  viewport.maxDepth = 1.f;
+  // draws the pre-pass leaves to the color pass
+  auto skip_depth = [&](const RenderObject &draw) {
+    return draw.material->pipeline->depthEqualPipeline == VK_NULL_HANDLE;
+  };
 
-  vkCmdSetViewport(cmd, 0, 1, &viewport);
+  constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  bool direct = !useIndirectDraws && !useGpuCulling;
 
-  VkRect2D scissor = {};
-  scissor.offset.x = 0;
-  scissor.offset.y = 0;
-  scissor.extent.width = viewport.width;
-  scissor.extent.height = viewport.height;
+  auto draw_batches = [&](CommandRecorder &rec, uint32_t begin, uint32_t end,
+                          bool depthOnly) {
+    for (uint32_t i = begin; i < end; i++) {
+      const DrawBatch &batch = _drawBatches[i];
+      const RenderObject &draw = draws[batch.object];
+      if (depthOnly && skip_depth(draw)) {
+        continue;
+      }
+      bind_state(rec, draw, depthOnly);
+      rec.draw_indexed(draw.indexCount, batch.instanceCount, draw.firstIndex,
+                       0, batch.firstInstance);
+    }
+  };
+
+  // only built for the indirect paths. The late cull phase writes its
+  // commands and counts after the ones of the early phase
+  auto draw_groups = [&](CommandRecorder &rec, uint32_t begin, uint32_t end,
+                         bool late, bool depthOnly) {
+    for (uint32_t g = begin; g < end; g++) {
+      const DrawGroup &group = _drawGroups[g];
+      // a group shares one material, so it is skipped as a whole
+      const RenderObject &first = draws[_drawBatches[group.first].object];
+      if (depthOnly && skip_depth(first)) {
+        continue;
+      }
+      bind_state(rec, first, depthOnly);
+
+      VkDeviceSize offset = group.first * stride;
+      if (useGpuCulling) {
+        VkDeviceSize commandBase = late ? _drawBatches.size() * stride : 0;
+        uint32_t countBase = late ? (uint32_t)_drawGroups.size() : 0;
+        // the group owns count command slots, the cull pass filled the
+        // front of them and wrote how many into its counter
+        rec.draw_indexed_indirect_count(
+            frame._culledDrawBuffer.buffer, commandBase + offset,
+            frame._drawCountBuffer.buffer, (countBase + g) * sizeof(uint32_t),
+            group.count, stride);
+      } else if (_multiDrawIndirect) {
+        rec.draw_indexed_indirect(frame._indirectBuffer.buffer, offset,
+                                  group.count, stride);
+      } else {
+        for (uint32_t i = 0; i < group.count; i++) {
+          rec.draw_indexed_indirect(frame._indirectBuffer.buffer,
+                                    offset + i * stride, 1, stride);
+        }
+      }
+    }
+  };
+
+  // one cull phase worth of draws: optionally depth first, then color. The
+  // late phase continues on top of the early one instead of clearing
+  auto geometry_pass = [&](bool late) {
+    bool groups = late || !direct;
+    uint32_t itemCount =
+        (uint32_t)(groups ? _drawGroups.size() : _drawBatches.size());
+    auto draw_items = [&](CommandRecorder &rec, uint32_t begin, uint32_t end,
+                          bool depthOnly) {
+      if (groups) {
+        draw_groups(rec, begin, end, late, depthOnly);
+      } else {
+        draw_batches(rec, begin, end, depthOnly);
+      }
+    };
 
-  vkCmdSetScissor(cmd, 0, 1, &scissor);
+    depthAttachment.loadOp =
+        late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+
+    if (prepass) {
+      VkRenderingInfo prepassInfo =
+          vkinit::rendering_info(_drawExtent, nullptr, &depthAttachment);
+      prepassInfo.colorAttachmentCount = 0;
+      record_geometry(cmd, prepassInfo, itemCount,
+                      [&](CommandRecorder &rec, uint32_t begin, uint32_t end) {
+                        draw_items(rec, begin, end, true);
+                      });
+
+      // rendering instances are not ordered against each other
+      vkutil::memory_barrier(
+          cmd, VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+          VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+          VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+              VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+          VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+              VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+      depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    }
 
-  // launch a draw command to draw 3 vertices
-  vkCmdDraw(cmd, 3, 1, 0, 0);
+    VkRenderingInfo renderInfo =
+        vkinit::rendering_info(_drawExtent, &colorAttachment, &depthAttachment);
+    record_geometry(cmd, renderInfo, itemCount,
+                    [&](CommandRecorder &rec, uint32_t begin, uint32_t end) {
+                      // launch a draw command to draw 3 vertices
+                      if (!late && begin == 0) {
+                        rec.bind_pipeline(_trianglePipeline);
+                        rec.draw(3, 1, 0, 0);
+                      }
+                      draw_items(rec, begin, end, false);
+                    });
+  };
+
+  stats.commandRecordTime = 0.f;
+
+  geometry_pass(false);
+
+  if (occlusion && !_drawGroups.empty()) {
+    // occluders are whatever the early phase drew
+    vkutil::transition_image(cmd, _depthImage.image,
+                             VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                             VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+    build_depth_pyramid(cmd);
+    vkutil::transition_image(cmd, _depthImage.image,
+                             VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                             VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
+    cull_draws(cmd, CULL_LATE);
+
+    geometry_pass(true);
+  }
 
-  // allocate a new uniform buffer for the scene data
-  AllocatedBuffer gpuSceneDataBuffer =
-      create_buffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VMA_MEMORY_USAGE_CPU_TO_GPU);
+  // blended on top of the finished opaque depth and color, one draw per
+  // surface so the back to front order holds
+  const std::vector<RenderObject> &transparent =
+      mainDrawContext.TransparentSurfaces;
+  if (!_transparentOrder.empty()) {
+    uint32_t firstInstance = (uint32_t)_drawOrder.size();
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    VkRenderingInfo transparentInfo =
+        vkinit::rendering_info(_drawExtent, &colorAttachment, &depthAttachment);
+    record_geometry(
+        cmd, transparentInfo, (uint32_t)_transparentOrder.size(),
+        [&](CommandRecorder &rec, uint32_t begin, uint32_t end) {
+          for (uint32_t i = begin; i < end; i++) {
+            const RenderObject &draw = transparent[_transparentOrder[i].index];
+            bind_state(rec, draw, false);
+            rec.draw_indexed(draw.indexCount, 1, draw.firstIndex, 0,
+                             firstInstance + i);
+          }
+        });
+  }
 
-  // add it to the deletion queue of this frame so it gets deleted once its been
-  // used
-  get_current_frame()._deletionQueue.push_function(
-      [=, this]() { destroy_buffer(gpuSceneDataBuffer); });
+  auto end = std::chrono::system_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  stats.drawRecordTime = elapsed.count() / 1000.f;
+}
 
-  // write the buffer
-  GPUSceneData *sceneUniformData =
-      (GPUSceneData *)gpuSceneDataBuffer.allocation->GetMappedData();
-  *sceneUniformData = sceneData;
+void VulkanEngine::record_geometry(VkCommandBuffer cmd,
+                                   const VkRenderingInfo &renderInfo,
+                                   uint32_t itemCount,
+                                   const GeometryRecordFn &record) {
+  CPU_ZONE("record geometry");
+  auto start = std::chrono::system_clock::now();
+  FrameData &frame = get_current_frame();
+
+  // dynamic state is not inherited, every secondary sets its own
+  auto set_viewport = [&](VkCommandBuffer buffer) {
+    VkViewport viewport = {};
+    viewport.x = 0;
+    viewport.y = 0;
+    viewport.width = _drawExtent.width;
+    viewport.height = _drawExtent.height;
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+
+    vkCmdSetViewport(buffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {};
+    scissor.offset.x = 0;
+    scissor.offset.y = 0;
+    scissor.extent.width = viewport.width;
+    scissor.extent.height = viewport.height;
+
+    vkCmdSetScissor(buffer, 0, 1, &scissor);
+  };
+
+  // a secondary only pays for itself with a few hundred draws in it
+  constexpr uint32_t MIN_CHUNK_ITEMS = 256;
+  uint32_t chunks = std::clamp(itemCount / MIN_CHUNK_ITEMS, 1u,
+                               std::min((uint32_t)recordThreads,
+                                        MAX_RECORD_THREADS));
+
+  if (chunks == 1) {
+    vkCmdBeginRendering(cmd, &renderInfo);
+    _recorder.begin(cmd);
+    set_viewport(cmd);
+    record(_recorder, 0, itemCount);
+    vkCmdEndRendering(cmd);
+  } else {
+    VkFormat colorFormat = _drawImage.imageFormat;
+    // depth only passes have no color attachment
+    VkCommandBufferInheritanceRenderingInfo renderingInheritance{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .colorAttachmentCount = renderInfo.colorAttachmentCount,
+        .pColorAttachmentFormats = &colorFormat,
+        .depthAttachmentFormat = _depthImage.imageFormat,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT};
+    VkCommandBufferInheritanceInfo inheritance{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = &renderingInheritance,
+        .pipelineStatistics = _gpuProfiler.statistics_flags()};
+
+    VkCommandBufferBeginInfo beginInfo = vkinit::command_buffer_begin_info(
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+        VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    beginInfo.pInheritanceInfo = &inheritance;
+
+    // chunk c always records through slot c, so no two threads ever share a
+    // pool, and executing the secondaries in chunk order keeps draw order
+    _secondaryBuffers.resize(chunks);
+    uint32_t chunkSize = (itemCount + chunks - 1) / chunks;
+    _jobs.parallel_for(chunks, 1, [&](uint32_t first, uint32_t last) {
+      CPU_ZONE("record chunk");
+      for (uint32_t c = first; c < last; c++) {
+        RecordSlot &slot = frame._recordSlots[c];
+        if (slot.used == slot.buffers.size()) {
+          VkCommandBufferAllocateInfo allocInfo =
+              vkinit::command_buffer_allocate_info(slot.pool, 1);
+          allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+          VkCommandBuffer buffer;
+          VK_CHECK(vkAllocateCommandBuffers(_device, &allocInfo, &buffer));
+          slot.buffers.push_back(buffer);
+        }
+        VkCommandBuffer buffer = slot.buffers[slot.used++];
+
+        VK_CHECK(vkBeginCommandBuffer(buffer, &beginInfo));
+        slot.recorder.begin(buffer);
+        set_viewport(buffer);
+        record(slot.recorder, std::min(c * chunkSize, itemCount),
+               std::min((c + 1) * chunkSize, itemCount));
+        VK_CHECK(vkEndCommandBuffer(buffer));
+
+        _secondaryBuffers[c] = buffer;
+      }
+    });
+
+    VkRenderingInfo secondaryRenderInfo = renderInfo;
+    secondaryRenderInfo.flags =
+        VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    vkCmdBeginRendering(cmd, &secondaryRenderInfo);
+    vkCmdExecuteCommands(cmd, chunks, _secondaryBuffers.data());
+    vkCmdEndRendering(cmd);
+
+    for (uint32_t c = 0; c < chunks; c++) {
+      _recorder.merge_stats(frame._recordSlots[c].recorder.stats());
+      frame._recordSlots[c].recorder.reset_stats();
+    }
+  }
+
+  auto end = std::chrono::system_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  stats.commandRecordTime += elapsed.count() / 1000.f;
+}
+
+void VulkanEngine::frustum_cull_objects() {
+  CPU_ZONE("cpu culling");
+  auto start = std::chrono::system_clock::now();
+
+  Frustum frustum = frustum_from_matrix(sceneData.viewproj);
+
+  // returns how many draws were removed from the list
+  auto cull_list = [&](std::vector<RenderObject> &draws) {
+    uint32_t count = (uint32_t)draws.size();
+
+    _cullBounds.resize(count);
+    uint32_t batches = _cullBounds.batch_count();
+    _cullMasks.resize(batches);
+
+    // world bounds and the test of a batch go together, so each thread works
+    // on bounds it just wrote
+    _jobs.parallel_for(batches, 1024, [&](uint32_t begin, uint32_t end) {
+      CPU_ZONE("cull chunk");
+      uint32_t last = std::min(end * cpucull::BATCH, count);
+      for (uint32_t i = begin * cpucull::BATCH; i < last; i++) {
+        const RenderObject &draw = draws[i];
+        const glm::mat4 &m = draw.transform;
+
+        glm::vec3 center = glm::vec3(m * glm::vec4(draw.bounds.origin, 1.f));
+        // a transformed box is bounded by the absolute matrix applied to its
+        // extents, and the sphere grows by the largest axis scale
+        glm::mat3 absolute{glm::abs(glm::vec3(m[0])),
+                           glm::abs(glm::vec3(m[1])),
+                           glm::abs(glm::vec3(m[2]))};
+        float scale = std::max(glm::length(glm::vec3(m[0])),
+                               std::max(glm::length(glm::vec3(m[1])),
+                                        glm::length(glm::vec3(m[2]))));
+
+        _cullBounds.set(i, center, draw.bounds.sphereRadius * scale,
+                        absolute * draw.bounds.extents);
+      }
+      cpucull::test_boxes(frustum, _cullBounds, begin, end, _cullMasks.data());
+    });
+
+    // compact in place, the survivors keep their order
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      if ((_cullMasks[i / cpucull::BATCH] >> (i % cpucull::BATCH)) & 1) {
+        if (kept != i) {
+          draws[kept] = draws[i];
+        }
+        kept++;
+      }
+    }
+    draws.resize(kept);
+    return count - kept;
+  };
+
+  stats.cpuCulled = cull_list(mainDrawContext.OpaqueSurfaces) +
+                    cull_list(mainDrawContext.TransparentSurfaces);
+
+  auto end = std::chrono::system_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  stats.cpuCullTime = elapsed.count() / 1000.f;
+}
+
+void VulkanEngine::sort_draws() {
+  CPU_ZONE("sort draws");
+  const std::vector<RenderObject> &draws = mainDrawContext.OpaqueSurfaces;
+
+  _drawOrder.resize(draws.size());
+  for (uint32_t i = 0; i < draws.size(); i++) {
+    const RenderObject &draw = draws[i];
+
+    // view space looks down -z
+    glm::vec4 center =
+        sceneData.view * draw.transform * glm::vec4(draw.bounds.origin, 1.f);
+    uint32_t depth = drawkey::depth_bucket(-center.z, 10000.f);
+
+    _drawOrder[i].index = i;
+    // a surface is a range of one mesh's index buffer
+    uint64_t surface =
+        draw.vertexBufferAddress ^ (uint64_t(draw.firstIndex) << 48);
+
+    // bindless draws never bind a material, so materials dont split them
+    uint64_t materialSet =
+        useBindless ? 0 : (uint64_t)draw.material->materialSet;
+
+    _drawOrder[i].key = drawkey::make(
+        (uint32_t)draw.material->passType,
+        _pipelineKeyIds.get((uint64_t)draw.material->pipeline->pipeline),
+        _materialKeyIds.get(materialSet),
+        _indexBufferKeyIds.get((uint64_t)draw.indexBuffer),
+        _surfaceKeyIds.get(surface), depth);
+  }
+
+  radix_sort_draws(_drawOrder, _drawSortScratch, _jobs);
+
+  // transparent draws blend over each other, so only distance counts and
+  // they go back to front whatever state they bind
+  const std::vector<RenderObject> &transparent =
+      mainDrawContext.TransparentSurfaces;
+
+  _transparentOrder.resize(transparent.size());
+  for (uint32_t i = 0; i < transparent.size(); i++) {
+    const RenderObject &draw = transparent[i];
 
-  // create a descriptor set that binds that buffer and update it
-  VkDescriptorSet globalDescriptor =
-      get_current_frame()._frameDescriptors.allocate(
-          _device, _gpuSceneDataDescriptorLayout);
+    glm::vec4 center =
+        sceneData.view * draw.transform * glm::vec4(draw.bounds.origin, 1.f);
+    uint32_t depth = drawkey::depth_bucket(-center.z, 10000.f);
+
+    _transparentOrder[i].index = i;
+    _transparentOrder[i].key = ((1u << drawkey::DEPTH_BITS) - 1) - depth;
+  }
+
+  radix_sort_draws(_transparentOrder, _drawSortScratch, _jobs);
+}
+
+// bindless draws carry their material per instance, so only the pipeline
+// has to match
+static bool same_surface(const RenderObject &a, const RenderObject &b,
+                         bool bindless) {
+  bool sameMaterial = bindless
+                          ? a.material->pipeline == b.material->pipeline
+                          : a.material == b.material;
+  return sameMaterial && a.indexBuffer == b.indexBuffer &&
+         a.firstIndex == b.firstIndex && a.indexCount == b.indexCount &&
+         a.vertexBufferAddress == b.vertexBufferAddress;
+}
 
+VkDeviceAddress VulkanEngine::build_draw_batches() {
+  CPU_ZONE("build draw batches");
+  const std::vector<RenderObject> &draws = mainDrawContext.OpaqueSurfaces;
+  const std::vector<RenderObject> &transparent =
+      mainDrawContext.TransparentSurfaces;
+  FrameData &frame = get_current_frame();
+
+  _drawBatches.clear();
+  _drawGroups.clear();
+  if (_drawOrder.empty() && _transparentOrder.empty()) {
+    return 0;
+  }
+
+  VkBuffer previousInstances = frame._instanceBuffer.buffer;
+  reserve_frame_buffer(frame._instanceBuffer,
+                       (_drawOrder.size() + _transparentOrder.size()) *
+                           sizeof(GPUInstanceData),
+                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  if (frame._instanceBuffer.buffer != previousInstances) {
+    frame._instanceBufferAddress = get_buffer_address(frame._instanceBuffer);
+  }
+
+  // instance i is the i-th draw in sorted order, so every batch covers a
+  // contiguous range of the buffer
+  GPUInstanceData *instances =
+      (GPUInstanceData *)frame._instanceBuffer.info.pMappedData;
+  _jobs.parallel_for((uint32_t)_drawOrder.size(), 4096,
+                     [&](uint32_t begin, uint32_t end) {
+                       CPU_ZONE("instance chunk");
+                       for (uint32_t i = begin; i < end; i++) {
+                         const RenderObject &draw = draws[_drawOrder[i].index];
+                         instances[i].worldMatrix = draw.transform;
+                         instances[i].vertexBuffer = draw.vertexBufferAddress;
+                         instances[i].positionBuffer =
+                             draw.positionBufferAddress;
+                         instances[i].materialIndex =
+                             draw.material->materialIndex;
+                       }
+                     });
+
+  // transparent instances follow in back to front order, one each
+  GPUInstanceData *transparentInstances = instances + _drawOrder.size();
+  for (uint32_t i = 0; i < _transparentOrder.size(); i++) {
+    const RenderObject &draw = transparent[_transparentOrder[i].index];
+    transparentInstances[i].worldMatrix = draw.transform;
+    transparentInstances[i].vertexBuffer = draw.vertexBufferAddress;
+    transparentInstances[i].positionBuffer = draw.positionBufferAddress;
+    transparentInstances[i].materialIndex = draw.material->materialIndex;
+  }
+  if (_drawOrder.empty()) {
+    return frame._instanceBufferAddress;
+  }
+
+  // gpu culling decides visibility per draw, so it needs one command each
+  bool instancing = useInstancing && !useGpuCulling;
+
+  for (uint32_t i = 0; i < _drawOrder.size(); i++) {
+    const RenderObject &draw = draws[_drawOrder[i].index];
+
+    if (instancing && !_drawBatches.empty()) {
+      DrawBatch &batch = _drawBatches.back();
+      if (same_surface(draws[batch.object], draw, useBindless)) {
+        batch.instanceCount++;
+        continue;
+      }
+    }
+
+    _drawBatches.push_back(DrawBatch{_drawOrder[i].index, i, 1});
+  }
+
+  if (!useIndirectDraws && !useGpuCulling) {
+    return frame._instanceBufferAddress;
+  }
+
+  // every run of batches that binds the same state becomes one indirect call
+  for (uint32_t i = 0; i < _drawBatches.size(); i++) {
+    const RenderObject &draw = draws[_drawBatches[i].object];
+    if (!_drawGroups.empty()) {
+      const RenderObject &first =
+          draws[_drawBatches[_drawGroups.back().first].object];
+      if (first.material->pipeline == draw.material->pipeline &&
+          (useBindless ||
+           first.material->materialSet == draw.material->materialSet) &&
+          first.indexBuffer == draw.indexBuffer) {
+        _drawGroups.back().count++;
+        continue;
+      }
+    }
+    _drawGroups.push_back(DrawGroup{i, 1});
+  }
+
+  if (useGpuCulling) {
+    write_cull_objects();
+    return frame._instanceBufferAddress;
+  }
+
+  reserve_frame_buffer(frame._indirectBuffer,
+                       _drawBatches.size() *
+                           sizeof(VkDrawIndexedIndirectCommand),
+                       VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+  VkDrawIndexedIndirectCommand *commands =
+      (VkDrawIndexedIndirectCommand *)frame._indirectBuffer.info.pMappedData;
+  for (uint32_t i = 0; i < _drawBatches.size(); i++) {
+    const DrawBatch &batch = _drawBatches[i];
+    const RenderObject &draw = draws[batch.object];
+
+    commands[i].indexCount = draw.indexCount;
+    commands[i].instanceCount = batch.instanceCount;
+    commands[i].firstIndex = draw.firstIndex;
+    commands[i].vertexOffset = 0;
+    commands[i].firstInstance = batch.firstInstance;
+  }
+
+  return frame._instanceBufferAddress;
+}
+
+void VulkanEngine::write_cull_objects() {
+  CPU_ZONE("write cull objects");
+  const std::vector<RenderObject> &draws = mainDrawContext.OpaqueSurfaces;
+  FrameData &frame = get_current_frame();
+
+  // without instancing batch i is draw i, so objects line up with instances
+  uint32_t count = (uint32_t)_drawBatches.size();
+  uint32_t groupCount = (uint32_t)_drawGroups.size();
+
+  reserve_frame_buffer(frame._cullObjectBuffer,
+                       sizeof(GPUCullData) + count * sizeof(GPUCullObject),
+                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  // the early and the late phase each get a full set of command slots
+  reserve_frame_buffer(frame._culledDrawBuffer,
+                       2 * count * sizeof(VkDrawIndexedIndirectCommand),
+                       VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                       VMA_MEMORY_USAGE_GPU_ONLY);
+  // counts of both phases, then the frustum and occlusion culled totals
+  size_t countBytes = (2 * groupCount + 2) * sizeof(uint32_t);
+  reserve_frame_buffer(frame._drawCountBuffer, countBytes,
+                       VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                           VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                           VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                       VMA_MEMORY_USAGE_GPU_ONLY);
+  reserve_frame_buffer(frame._cullStatsBuffer, countBytes,
+                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                       VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+  // the visibility of the last frame only means something for the same set
+  // of objects, start over with everything visible when it changes
+  if (count != _visibilityCount) {
+    if (_visibilityBuffer.buffer != VK_NULL_HANDLE) {
+      _frameDeletionQueue.push_buffer(_visibilityBuffer, _frameNumber);
+    }
+    _visibilityBuffer = create_buffer(
+        std::max(count, 1u) * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    _visibilityCount = count;
+    _visibilityReset = true;
+  }
+
+  uint8_t *mapped = (uint8_t *)frame._cullObjectBuffer.info.pMappedData;
+
+  GPUCullData *data = (GPUCullData *)mapped;
+  Frustum frustum = frustum_from_matrix(sceneData.viewproj);
+  std::copy(std::begin(frustum.planes), std::end(frustum.planes),
+            data->frustum);
+  data->view = sceneData.view;
+  const glm::mat4 &proj = sceneData.proj;
+  data->projection =
+      glm::vec4(proj[0][0], proj[1][1], proj[2][2], proj[3][2]);
+  data->pyramidSize = glm::vec2(_depthPyramidExtent.width,
+                                _depthPyramidExtent.height);
+  // distance where depth reaches 1, the near plane of the reversed depth
+  data->znear = proj[3][2] / (1.f + proj[2][2]);
+  data->objectCount = count;
+
+  GPUCullObject *objects = (GPUCullObject *)(mapped + sizeof(GPUCullData));
+  for (uint32_t g = 0; g < _drawGroups.size(); g++) {
+    const DrawGroup &group = _drawGroups[g];
+    for (uint32_t i = group.first; i < group.first + group.count; i++) {
+      const RenderObject &draw = draws[_drawBatches[i].object];
+
+      objects[i].sphere =
+          glm::vec4(draw.bounds.origin, draw.bounds.sphereRadius);
+      objects[i].indexCount = draw.indexCount;
+      objects[i].firstIndex = draw.firstIndex;
+      objects[i].group = g;
+      objects[i].groupStart = group.first;
+      objects[i].object = _drawBatches[i].object;
+    }
+  }
+}
+
+void VulkanEngine::cull_draws(VkCommandBuffer cmd, CullPhase phase) {
+  FrameData &frame = get_current_frame();
+  if (_drawGroups.empty()) {
+    return;
+  }
+  uint32_t groupCount = (uint32_t)_drawGroups.size();
+
+  if (phase != CULL_LATE) {
+    // the shader bumps the counts atomically, start them at zero. The late
+    // phase keeps adding to the totals of the early one
+    vkCmdFillBuffer(cmd, frame._drawCountBuffer.buffer, 0,
+                    (2 * groupCount + 2) * sizeof(uint32_t), 0);
+    if (_visibilityReset) {
+      vkCmdFillBuffer(cmd, _visibilityBuffer.buffer, 0, VK_WHOLE_SIZE, 1);
+      _visibilityReset = false;
+    }
+    // also orders the visibility reads after the previous frame's late
+    // phase wrote them
+    vkutil::memory_barrier(
+        cmd,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    // the set below is bound for every phase, so the pyramid has to be in
+    // its sampled layout before the late phase has anything in it
+    if (phase == CULL_EARLY) {
+      vkutil::transition_image(cmd, _depthPyramid.image,
+                               VK_IMAGE_LAYOUT_UNDEFINED,
+                               VK_IMAGE_LAYOUT_GENERAL);
+    }
+  }
+
+  auto descriptorStart = std::chrono::system_clock::now();
   DescriptorWriter writer;
-  writer.write_buffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0,
-                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-  writer.update_set(_device, globalDescriptor);
+  if (phase == CULL_SINGLE) {
+    // there is no pyramid, the shader never samples in this phase but the
+    // binding still needs a valid image
+    writer.write_image(0, _whiteImage.imageView, _depthReduceSampler,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  } else {
+    writer.write_image(0, _depthPyramid.imageView, _depthReduceSampler,
+                       VK_IMAGE_LAYOUT_GENERAL,
+                       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  }
+  VkDescriptorSet pyramidSet = VK_NULL_HANDLE;
+  if (!_pushDescriptors) {
+    pyramidSet =
+        frame._frameDescriptors.allocate(_device, _cullDescriptorLayout);
+    writer.update_set(_device, pyramidSet);
+  }
+  stats.descriptorTime += elapsed_ms(descriptorStart);
+
+  CullPushConstants push;
+  push.cullData = get_buffer_address(frame._cullObjectBuffer);
+  push.instances = frame._instanceBufferAddress;
+  push.commands = get_buffer_address(frame._culledDrawBuffer);
+  push.counts = get_buffer_address(frame._drawCountBuffer);
+  push.visibility = get_buffer_address(_visibilityBuffer);
+  push.phase = phase;
+  push.groupCount = groupCount;
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+  if (_pushDescriptors) {
+    writer.push_set(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout,
+                    0);
+  } else {
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            _cullPipelineLayout, 0, 1, &pyramidSet, 0,
+                            nullptr);
+  }
+  vkCmdPushConstants(cmd, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(CullPushConstants), &push);
 
-  for (const RenderObject &draw : mainDrawContext.OpaqueSurfaces) {
+  // 64 wide workgroups, one invocation per draw
+  uint32_t count = (uint32_t)_drawBatches.size();
+  vkCmdDispatch(cmd, (count + 63) / 64, 1, 1);
+
+  vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                         VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                         VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_2_COPY_BIT,
+                         VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                             VK_ACCESS_2_TRANSFER_READ_BIT);
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      draw.material->pipeline->pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            draw.material->pipeline->layout, 0, 1,
-                            &globalDescriptor, 0, nullptr);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            draw.material->pipeline->layout, 1, 1,
-                            &draw.material->materialSet, 0, nullptr);
+  if (phase == CULL_EARLY) {
+    return;
+  }
+
+  // the counts are final now, keep a copy the cpu can read once the frame is
+  // done
+  VkBufferCopy copy{};
+  copy.size = (2 * groupCount + 2) * sizeof(uint32_t);
+  vkCmdCopyBuffer(cmd, frame._drawCountBuffer.buffer,
+                  frame._cullStatsBuffer.buffer, 1, &copy);
+  vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_COPY_BIT,
+                         VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                         VK_PIPELINE_STAGE_2_HOST_BIT,
+                         VK_ACCESS_2_HOST_READ_BIT);
+  frame._cullStatsGroups = groupCount;
+}
+
+void VulkanEngine::build_depth_pyramid(VkCommandBuffer cmd) {
+  FrameData &frame = get_current_frame();
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _depthReducePipeline);
+
+  for (uint32_t level = 0; level < _depthPyramidMips.size(); level++) {
+    VkExtent3D levelExtent = vkutil::mip_level_extent(
+        VkExtent3D{_depthPyramidExtent.width, _depthPyramidExtent.height, 1},
+        level);
+
+    DepthReducePushConstants push;
+    push.outSize = glm::vec2(levelExtent.width, levelExtent.height);
+
+    // level 0 reads the rendered part of the depth target, every other level
+    // all of the level before it
+    auto descriptorStart = std::chrono::system_clock::now();
+    DescriptorWriter writer;
+    writer.write_image(0, _depthPyramidMips[level], VK_NULL_HANDLE,
+                       VK_IMAGE_LAYOUT_GENERAL,
+                       VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    if (level == 0) {
+      writer.write_image(1, _depthImage.imageView, _depthReduceSampler,
+                         VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+      push.uvScale =
+          glm::vec2(float(_drawExtent.width) / _depthImage.imageExtent.width,
+                    float(_drawExtent.height) / _depthImage.imageExtent.height);
+    } else {
+      writer.write_image(1, _depthPyramidMips[level - 1], _depthReduceSampler,
+                         VK_IMAGE_LAYOUT_GENERAL,
+                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+      push.uvScale = glm::vec2(1.f);
+    }
+
+    if (_pushDescriptors) {
+      writer.push_set(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      _depthReducePipelineLayout, 0);
+    } else {
+      VkDescriptorSet set = frame._frameDescriptors.allocate(
+          _device, _depthReduceDescriptorLayout);
+      writer.update_set(_device, set);
 
-    vkCmdBindIndexBuffer(cmd, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              _depthReducePipelineLayout, 0, 1, &set, 0,
+                              nullptr);
+    }
+    stats.descriptorTime += elapsed_ms(descriptorStart);
+    vkCmdPushConstants(cmd, _depthReducePipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(DepthReducePushConstants), &push);
+    vkCmdDispatch(cmd, (levelExtent.width + 15) / 16,
+                  (levelExtent.height + 15) / 16, 1);
+
+    // the next level and finally the late cull pass read what this wrote
+    vkutil::memory_barrier(cmd, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                           VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                           VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+  }
+}
 
-    GPUDrawPushConstants pushConstants;
-    pushConstants.vertexBuffer = draw.vertexBufferAddress;
-    pushConstants.worldMatrix = draw.transform;
-    vkCmdPushConstants(cmd, draw.material->pipeline->layout,
-                       VK_SHADER_STAGE_VERTEX_BIT, 0,
-                       sizeof(GPUDrawPushConstants), &pushConstants);
+void VulkanEngine::read_cull_stats() {
+  FrameData &frame = get_current_frame();
+  if (frame._cullStatsGroups == 0) {
+    return;
+  }
 
-    vkCmdDrawIndexed(cmd, draw.indexCount, 1, draw.firstIndex, 0, 0);
+  uint32_t groupCount = frame._cullStatsGroups;
+  vmaInvalidateAllocation(_allocator, frame._cullStatsBuffer.allocation, 0,
+                          VK_WHOLE_SIZE);
+  const uint32_t *counts =
+      (const uint32_t *)frame._cullStatsBuffer.info.pMappedData;
+
+  CullStats &culling = stats.culling;
+  culling = {};
+  for (uint32_t g = 0; g < groupCount; g++) {
+    culling.drawnEarly += counts[g];
+    culling.drawnLate += counts[groupCount + g];
   }
-  vkCmdEndRendering(cmd);
+  culling.frustumCulled = counts[2 * groupCount];
+  culling.occlusionCulled = counts[2 * groupCount + 1];
+  culling.objects = culling.drawnEarly + culling.drawnLate +
+                    culling.frustumCulled + culling.occlusionCulled;
+
+  frame._cullStatsGroups = 0;
+}
+
+void VulkanEngine::read_gpu_time() {
+  // the fence has signaled, so the results are there without waiting
+  FrameData &frame = get_current_frame();
+  if (!_gpuProfiler.resolve(_device, get_current_frame_index())) {
+    return;
+  }
+
+  // only the work that scales with renderScale counts, the blit and imgui
+  // run at a fixed size
+  const GpuProfiler::Zone *background = _gpuProfiler.find("background");
+  const GpuProfiler::Zone *geometry = _gpuProfiler.find("geometry");
+  const GpuProfiler::Zone *whole = _gpuProfiler.find("frame");
+  stats.gpuTime = (background ? background->last : 0.f) +
+                  (geometry ? geometry->last : 0.f);
+
+  // place the end of the frame on the cpu clock by how long ago it was on
+  // the gpu clock
+  if (_getCalibratedTimestamps && whole) {
+    VkCalibratedTimestampInfoEXT info{
+        .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+        .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT};
+    uint64_t gpuNow;
+    uint64_t deviation;
+    auto cpuNow = std::chrono::steady_clock::now();
+    VK_CHECK(_getCalibratedTimestamps(_device, 1, &info, &gpuNow, &deviation));
+
+    double sinceEndMs =
+        (gpuNow - whole->lastEndTicks) * _timestampPeriod / 1000000.0;
+    double sinceInputMs =
+        std::chrono::duration<double, std::milli>(cpuNow - frame._inputTime)
+            .count();
+    stats.inputToGpu = float(sinceInputMs - sinceEndMs);
+    if (stats.inputToGpuAverage <= 0.f) {
+      stats.inputToGpuAverage = stats.inputToGpu;
+    } else {
+      stats.inputToGpuAverage +=
+          (stats.inputToGpu - stats.inputToGpuAverage) * 0.05f;
+    }
+  }
+
+  // the measured frame is up to FRAME_OVERLAP old, the controller holds the
+  // scale for longer than that after every change
+  if (useDynamicResolution) {
+    renderScale = dynamicResolution.update(stats.gpuTime, renderScale);
+  }
+}
+
+void VulkanEngine::apply_present_settings() {
+  framesInFlight = std::clamp(framesInFlight, 1, (int)FRAME_OVERLAP);
+  if (framesInFlight != _framesInFlight || presentMode != _presentMode) {
+    // what the outgoing configuration measured, so configurations can be
+    // compared from the log
+    if (stats.inputToGpuAverage > 0.f) {
+      fmt::println("{}, {} frames in flight, limit {} fps: input to gpu "
+                   "complete {:.2f} ms",
+                   present_mode_name(_presentMode), _framesInFlight,
+                   frameLimit, stats.inputToGpuAverage);
+    }
+    stats.inputToGpuAverage = 0.f;
+  }
+
+  if (framesInFlight != _framesInFlight) {
+    // frames map to slots by their number modulo the count, no slot may be
+    // in use while that changes
+    VK_CHECK(vkDeviceWaitIdle(_device));
+    _framesInFlight = framesInFlight;
+    // timings left in slots that sat unused are too old to mean anything
+    _gpuProfiler.discard();
+  }
+
+  if (presentMode != _presentMode) {
+    if (std::find(_supportedPresentModes.begin(), _supportedPresentModes.end(),
+                  presentMode) == _supportedPresentModes.end()) {
+      fmt::println("present mode {} is not supported", (int)presentMode);
+      presentMode = _presentMode;
+      return;
+    }
+    // the rebuild keeps the size, resize_swapchain picks the mode up
+    _presentMode = presentMode;
+    resize_requested = true;
+  }
+}
+
+void VulkanEngine::limit_frame_rate() {
+  if (frameLimit <= 0.f) {
+    _nextFrameTime = {};
+    return;
+  }
+  CPU_ZONE("frame limiter");
+
+  auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / frameLimit));
+  auto now = std::chrono::steady_clock::now();
+  // a frame that ran long moves the schedule instead of being caught up on
+  if (_nextFrameTime < now - period) {
+    _nextFrameTime = now;
+  }
+
+  // sleeps overshoot by up to a scheduler tick, so the last stretch spins
+  constexpr auto spin = std::chrono::milliseconds{2};
+  while (now < _nextFrameTime) {
+    if (_nextFrameTime - now > spin) {
+      std::this_thread::sleep_for(_nextFrameTime - now - spin);
+    } else {
+      std::this_thread::yield();
+    }
+    now = std::chrono::steady_clock::now();
+  }
+  _nextFrameTime += period;
+}
+
+void VulkanEngine::update_cpu_trace() {
+  if (_cpuTraceFramesLeft == 0) {
+    return;
+  }
+  // asked for during this frame, the trace starts with the next one
+  if (!cpuprof::capturing()) {
+    cpuprof::begin_capture();
+    return;
+  }
+  if (--_cpuTraceFramesLeft > 0) {
+    return;
+  }
+  cpuprof::end_capture();
+  cpuprof::write_chrome_trace(cpuTracePath);
+}
+
+void VulkanEngine::reserve_frame_buffer(AllocatedBuffer &buffer, size_t bytes,
+                                        VkBufferUsageFlags usage,
+                                        VmaMemoryUsage memoryUsage) {
+  if (buffer.buffer != VK_NULL_HANDLE && buffer.info.size >= bytes) {
+    return;
+  }
+  if (buffer.buffer != VK_NULL_HANDLE) {
+    _frameDeletionQueue.push_buffer(buffer, _frameNumber);
+  }
+
+  // leave some room so a slowly growing scene doesnt reallocate every frame
+  size_t capacity = std::max(bytes + bytes / 2, size_t(64 * 1024));
+  buffer = create_buffer(capacity, usage, memoryUsage);
+}
+
+VkDeviceAddress VulkanEngine::get_buffer_address(const AllocatedBuffer &buffer) {
+  VkBufferDeviceAddressInfo addressInfo{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+      .buffer = buffer.buffer};
+  return vkGetBufferDeviceAddress(_device, &addressInfo);
+}
+
+void VulkanEngine::update_draw_benchmark() {
+  DrawBenchmark &bench = drawBenchmark;
+  if (!bench.running) {
+    return;
+  }
+
+  // the record time of the previous frame belongs to the current config
+  bench.frame++;
+  if (bench.frame > DrawBenchmark::WARMUP_FRAMES) {
+    bench.accumulated += stats.drawRecordTime;
+  }
+
+  if (bench.frame == DrawBenchmark::WARMUP_FRAMES +
+                         DrawBenchmark::MEASURE_FRAMES) {
+    bench.results[bench.config / 2][bench.config % 2] =
+        float(bench.accumulated / DrawBenchmark::MEASURE_FRAMES);
+    bench.config++;
+    bench.frame = 0;
+    bench.accumulated = 0;
+  }
+
+  if (bench.config == DrawBenchmark::CONFIG_COUNT) {
+    bench.running = false;
+    bench.hasResults = true;
+    stressCubes = bench.savedStressCubes;
+    useInstancing = bench.savedInstancing;
+    useIndirectDraws = bench.savedIndirect;
+    useCpuCulling = bench.savedCpuCulling;
+
+    for (uint32_t i = 0; i < std::size(DrawBenchmark::DRAW_COUNTS); i++) {
+      fmt::println("draw benchmark {:>6} draws: direct {:.3f} ms, indirect "
+                   "{:.3f} ms",
+                   DrawBenchmark::DRAW_COUNTS[i], bench.results[i][0],
+                   bench.results[i][1]);
+    }
+    return;
+  }
+
+  stressCubes = DrawBenchmark::DRAW_COUNTS[bench.config / 2];
+  useIndirectDraws = bench.config % 2 == 1;
+  useInstancing = false;
+  // every cube has to reach the draw path, visible or not
+  useCpuCulling = false;
+}
+
+void VulkanEngine::update_record_benchmark() {
+  RecordBenchmark &bench = recordBenchmark;
+  if (!bench.running) {
+    return;
+  }
+
+  bench.frame++;
+  if (bench.frame > RecordBenchmark::WARMUP_FRAMES) {
+    bench.accumulated += stats.commandRecordTime;
+  }
+
+  if (bench.frame == RecordBenchmark::WARMUP_FRAMES +
+                         RecordBenchmark::MEASURE_FRAMES) {
+    bench.results[bench.config] =
+        float(bench.accumulated / RecordBenchmark::MEASURE_FRAMES);
+    bench.config++;
+    bench.frame = 0;
+    bench.accumulated = 0;
+  }
+
+  if (bench.config == std::size(RecordBenchmark::THREAD_COUNTS)) {
+    bench.running = false;
+    bench.hasResults = true;
+    stressCubes = bench.savedStressCubes;
+    useInstancing = bench.savedInstancing;
+    useCpuCulling = bench.savedCpuCulling;
+    recordThreads = bench.savedRecordThreads;
+
+    for (uint32_t i = 0; i < std::size(RecordBenchmark::THREAD_COUNTS); i++) {
+      fmt::println("record benchmark {:>2} threads: {:.3f} ms, {:.2f}x",
+                   RecordBenchmark::THREAD_COUNTS[i], bench.results[i],
+                   bench.results[0] / bench.results[i]);
+    }
+    return;
+  }
+
+  stressCubes = RecordBenchmark::DRAWS;
+  recordThreads = RecordBenchmark::THREAD_COUNTS[bench.config];
+  useInstancing = false;
+  useCpuCulling = false;
 }
 
 void VulkanEngine::draw_imgui(VkCommandBuffer cmd,
@@ -348,7 +1495,7 @@ void VulkanEngine::draw_imgui(VkCommandBuffer cmd,
   VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(
       targetImageView, nullptr, VK_IMAGE_LAYOUT_GENERAL);
   VkRenderingInfo renderInfo =
-      vkinit::rendering_info(_windowExtent, &colorAttachment, nullptr);
+      vkinit::rendering_info(_swapchainExtent, &colorAttachment, nullptr);
 
   vkCmdBeginRendering(cmd, &renderInfo);
 
@@ -358,7 +1505,34 @@ void VulkanEngine::draw_imgui(VkCommandBuffer cmd,
 }
 
 void VulkanEngine::update_scene() {
+  CPU_ZONE("update scene");
+  if (_replaying) {
+    replay_scene();
+  } else {
+    build_scene();
+  }
+
+  if (_captureFramesLeft > 0) {
+    _frameCapture.capture(mainDrawContext, sceneData, currentBackgroundEffect,
+                          backgroundEffects[currentBackgroundEffect].data);
+    if (--_captureFramesLeft == 0) {
+      _frameCapture.write(capturePath);
+    }
+  }
+
+  if (useCpuCulling && !useGpuCulling) {
+    frustum_cull_objects();
+  } else {
+    stats.cpuCullTime = 0.f;
+    stats.cpuCulled = 0;
+  }
+
+  request_texture_footprints();
+}
+
+void VulkanEngine::build_scene() {
   mainDrawContext.OpaqueSurfaces.clear();
+  mainDrawContext.TransparentSurfaces.clear();
 
   for (auto &m : loadedNodes) {
     m.second->Draw(glm::mat4{1.f}, mainDrawContext);
@@ -372,39 +1546,94 @@ void VulkanEngine::update_scene() {
     loadedNodes["Cube"]->Draw(translation * scale, mainDrawContext);
   }
 
-  sceneData.view = glm::translate(glm::vec3{0, 0, -5});
-  // camera projection
-  sceneData.proj = glm::perspective(
-      glm::radians(70.f),
-      (float)_windowExtent.width / (float)_windowExtent.height, 10000.f, 0.1f);
+  // a square grid of small cubes under the scene
+  int side = (int)std::ceil(std::sqrt((float)stressCubes));
+  for (int i = 0; i < stressCubes; i++) {
+    glm::mat4 scale = glm::scale(glm::vec3{0.1});
+    glm::mat4 translation = glm::translate(
+        glm::vec3{(i % side - side / 2) * 0.5f, -2, -(i / side) * 0.5f});
+
+    loadedNodes["Cube"]->Draw(translation * scale, mainDrawContext);
+  }
+
+  // frametime is the previous frame's, close enough for moving the camera
+  mainCamera.update(stats.frametime / 1000.f);
 
-  // invert the Y direction on projection matrix so that we are more similar
-  // to opengl and gltf axis
-  sceneData.proj[1][1] *= -1;
+  sceneData.view = mainCamera.get_view_matrix();
+  sceneData.proj = mainCamera.get_projection_matrix(
+      (float)_windowExtent.width / (float)_windowExtent.height);
   sceneData.viewproj = sceneData.proj * sceneData.view;
 }
 
+void VulkanEngine::replay_scene() {
+  const CapturedFrame &frame =
+      _frameCapture.frame(_replayFrame++ % _frameCapture.frame_count());
+  _frameCapture.replay(frame, mainDrawContext);
+  sceneData = frame.sceneData;
+
+  currentBackgroundEffect = std::min<int>(frame.backgroundEffect,
+                                          backgroundEffects.size() - 1);
+  backgroundEffects[currentBackgroundEffect].data = frame.effectData;
+}
+
 void VulkanEngine::draw() {
+  CPU_ZONE("draw");
+  auto start = std::chrono::system_clock::now();
   update_scene();
+  auto end = std::chrono::system_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  stats.sceneUpdateTime = elapsed.count() / 1000.f;
 
   //> frame_clear
   // wait until the gpu has finished rendering the last frame. Timeout of 1
   // second
-  VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence, true,
-                           1000000000));
+  {
+    CPU_ZONE("wait for gpu");
+    VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence,
+                             true, 1000000000));
+  }
 
-  get_current_frame()._deletionQueue.flush();
+  // the fence also means every frame up to _framesInFlight ago is done
+  if (_frameNumber >= _framesInFlight) {
+    _frameDeletionQueue.retire(_device, _allocator,
+                               _frameNumber - _framesInFlight);
+    _bindless.collect(_frameNumber - _framesInFlight);
+  }
+  // nothing is allocated from the pools with push descriptors, resetting
+  // them is the part of the cost that goes away
+  auto descriptorStart = std::chrono::system_clock::now();
   get_current_frame()._frameDescriptors.clear_pools(_device);
+  stats.descriptorTime = elapsed_ms(descriptorStart);
+  for (RecordSlot &slot : get_current_frame()._recordSlots) {
+    if (slot.used > 0) {
+      VK_CHECK(vkResetCommandPool(_device, slot.pool, 0));
+      slot.used = 0;
+    }
+  }
+  read_cull_stats();
+  read_gpu_time();
   //< frame_clear
 
-  // request image from the swapchain
-  uint32_t swapchainImageIndex;
+  // request image from the swapchain. Headless there is none, the frame
+  // ends in the draw image
+  uint32_t swapchainImageIndex = 0;
+  if (!headless) {
+    CPU_ZONE("acquire");
+    VkResult e = vkAcquireNextImageKHR(_device, _swapchain, 1000000000,
+                                       get_current_frame()._swapchainSemaphore,
+                                       nullptr, &swapchainImageIndex);
+    if (e == VK_ERROR_OUT_OF_DATE_KHR) {
+      // nothing was acquired and the fence is still signaled, so the frame can
+      // simply be retried once run() has rebuilt the swapchain
+      resize_requested = true;
+      return;
+    }
+  }
 
-  VkResult e = vkAcquireNextImageKHR(_device, _swapchain, 1000000000,
-                                     get_current_frame()._swapchainSemaphore,
-                                     nullptr, &swapchainImageIndex);
-  if (e == VK_ERROR_OUT_OF_DATE_KHR) {
-    return;
+  // the pool only reallocates when a declaration changed, like after a resize
+  if (declare_render_targets()) {
+    _drawImageVersion++;
   }
 
   _drawExtent.height =
@@ -430,45 +1659,75 @@ void VulkanEngine::draw() {
 
   VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
+  FrameData &frame = get_current_frame();
+  _gpuProfiler.begin_frame(cmd, get_current_frame_index());
+  uint32_t frameZone = _gpuProfiler.begin_zone(cmd, "frame");
+
+  _recorder.reset_stats();
+
+  // stream in texture levels before anything samples them this frame
+  _textureStreamer.update(this, cmd);
+  refresh_streamed_materials();
+  _bindless.flush(cmd);
+
   // transition our main draw image into general layout so we can write into it
   // we will overwrite it all so we dont care about what was the older layout
   vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
                            VK_IMAGE_LAYOUT_GENERAL);
 
-  draw_background(cmd);
+  {
+    GpuZoneScope zone(_gpuProfiler, cmd, "background",
+                      usePipelineStatistics);
+    draw_background(cmd);
+  }
 
   vkutil::transition_image(cmd, _drawImage.image, VK_IMAGE_LAYOUT_GENERAL,
                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
   vkutil::transition_image(cmd, _depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED,
                            VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
-  draw_geometry(cmd);
-
-  // transtion the draw image and the swapchain image into their correct
-  // transfer layouts
-  vkutil::transition_image(cmd, _drawImage.image,
-                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-  vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
-                           VK_IMAGE_LAYOUT_UNDEFINED,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-  // execute a copy from the draw image into the swapchain
-  vkutil::copy_image_to_image(cmd, _drawImage.image,
-                              _swapchainImages[swapchainImageIndex],
-                              _drawExtent, _swapchainExtent);
-
-  // set swapchain image layout to Attachment Optimal so we can draw it
-  vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  {
+    GpuZoneScope zone(_gpuProfiler, cmd, "geometry", usePipelineStatistics);
+    draw_geometry(cmd);
+  }
+
+  if (!headless) {
+    // transtion the draw image and the swapchain image into their correct
+    // transfer layouts
+    vkutil::transition_image(cmd, _drawImage.image,
+                             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
+                             VK_IMAGE_LAYOUT_UNDEFINED,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    // execute a copy from the draw image into the swapchain
+    {
+      GpuZoneScope zone(_gpuProfiler, cmd, "blit");
+      vkutil::copy_image_to_image(cmd, _drawImage.image,
+                                  _swapchainImages[swapchainImageIndex],
+                                  _drawExtent, _swapchainExtent);
+    }
+
+    // set swapchain image layout to Attachment Optimal so we can draw it
+    vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+    // draw imgui into the swapchain image
+    {
+      GpuZoneScope zone(_gpuProfiler, cmd, "imgui");
+      draw_imgui(cmd, _swapchainImageViews[swapchainImageIndex]);
+    }
 
-  // draw imgui into the swapchain image
-  draw_imgui(cmd, _swapchainImageViews[swapchainImageIndex]);
+    // set swapchain image layout to Present so we can draw it
+    vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
+                             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                             VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  }
 
-  // set swapchain image layout to Present so we can draw it
-  vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
-                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                           VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  // the end of the frame zone is where the image is handed to presentation
+  _gpuProfiler.end_zone(cmd, frameZone);
+  frame._inputTime = _inputTime;
 
   // finalize the command buffer (we can no longer add commands, but it can now
   // be executed)
@@ -488,29 +1747,51 @@ void VulkanEngine::draw() {
       vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT,
                                     get_current_frame()._renderSemaphore);
 
-  VkSubmitInfo2 submit = vkinit::submit_info(&cmdinfo, &signalInfo, &waitInfo);
+  // headless nothing is acquired or presented, so there is nothing to wait
+  // for or signal
+  VkSubmitInfo2 submit =
+      headless ? vkinit::submit_info(&cmdinfo, nullptr, nullptr)
+               : vkinit::submit_info(&cmdinfo, &signalInfo, &waitInfo);
 
   // submit command buffer to the queue and execute it.
   //  _renderFence will now block until the graphic commands finish execution
-  VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit,
-                          get_current_frame()._renderFence));
-
-  // prepare present
-  //  this will put the image we just rendered to into the visible window.
-  //  we want to wait on the _renderSemaphore for that,
-  //  as its necessary that drawing commands have finished before the image is
-  //  displayed to the user
-  VkPresentInfoKHR presentInfo = vkinit::present_info();
-
-  presentInfo.pSwapchains = &_swapchain;
-  presentInfo.swapchainCount = 1;
-
-  presentInfo.pWaitSemaphores = &get_current_frame()._renderSemaphore;
-  presentInfo.waitSemaphoreCount = 1;
-
-  presentInfo.pImageIndices = &swapchainImageIndex;
+  {
+    CPU_ZONE("submit");
+    VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit,
+                            get_current_frame()._renderFence));
+  }
 
-  VkResult presentResult = vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+  if (!headless) {
+    CPU_ZONE("present");
+    // prepare present
+    //  this will put the image we just rendered to into the visible window.
+    //  we want to wait on the _renderSemaphore for that,
+    //  as its necessary that drawing commands have finished before the image is
+    //  displayed to the user
+    VkPresentInfoKHR presentInfo = vkinit::present_info();
+
+    presentInfo.pSwapchains = &_swapchain;
+    presentInfo.swapchainCount = 1;
+
+    presentInfo.pWaitSemaphores = &get_current_frame()._renderSemaphore;
+    presentInfo.waitSemaphoreCount = 1;
+
+    presentInfo.pImageIndices = &swapchainImageIndex;
+
+    VkResult presentResult = vkQueuePresentKHR(_graphicsQueue, &presentInfo);
+    if (presentResult == VK_ERROR_OUT_OF_DATE_KHR) {
+      resize_requested = true;
+    } else if (presentResult == VK_SUBOPTIMAL_KHR) {
+      // suboptimal also comes back for things a rebuild does not change, like
+      // a rotated surface, so only rebuild when the size is off
+      int w, h;
+      SDL_GetWindowSize(_window, &w, &h);
+      if ((uint32_t)w != _swapchainExtent.width ||
+          (uint32_t)h != _swapchainExtent.height) {
+        resize_requested = true;
+      }
+    }
+  }
 
   // increase the number of frames drawn
   _frameNumber++;
@@ -581,26 +1862,139 @@ void VulkanEngine::init_imgui() {
   });
 }
 
+void VulkanEngine::run_headless() {
+  // the first frames carry pipeline and upload warm up, the gpu time only
+  // counts once the frames in flight have been read back
+  double frameTime = 0.0;
+  double recordTime = 0.0;
+  double gpuTime = 0.0;
+  int gpuFrames = 0;
+  if (headlessCpuTrace && headlessFrames > 0) {
+    _cpuTraceFramesLeft = headlessFrames;
+    cpuprof::begin_capture();
+  }
+  for (int i = 0; i < headlessFrames; i++) {
+    CPU_ZONE("frame");
+    auto start = std::chrono::system_clock::now();
+    _inputTime = std::chrono::steady_clock::now();
+    draw();
+
+    stats.frametime = elapsed_ms(start);
+    frameTime += stats.frametime;
+    recordTime += stats.drawRecordTime;
+    if (_gpuTimestamps && i >= _framesInFlight) {
+      gpuTime += stats.gpuTime;
+      gpuFrames++;
+    }
+    update_cpu_trace();
+  }
+  VK_CHECK(vkDeviceWaitIdle(_device));
+
+  int frames = std::max(headlessFrames, 1);
+  fmt::println("headless: {} frames at {}x{}", headlessFrames,
+               _drawExtent.width, _drawExtent.height);
+  if (_replaying) {
+    fmt::println("replayed {} captured frames from {}",
+                 _frameCapture.frame_count(), replayPath);
+  }
+  fmt::println("cpu frame {:.3f} ms, geometry recording {:.3f} ms",
+               frameTime / frames, recordTime / frames);
+  if (gpuFrames > 0) {
+    fmt::println("gpu {:.3f} ms", gpuTime / gpuFrames);
+  }
+
+  if (headlessReport.empty()) {
+    return;
+  }
+  std::ofstream report(headlessReport);
+  if (!report) {
+    fmt::println("could not write {}", headlessReport);
+    return;
+  }
+
+  // pass times cover the profiler history, the statistics the last frame
+  // read back. capturedFrames is 0 for the usual scene
+  report << fmt::format("{{\n  \"frames\": {},\n"
+                        "  \"capturedFrames\": {},\n  \"width\": {},\n"
+                        "  \"height\": {},\n  \"cpuFrameMs\": {:.4f},\n"
+                        "  \"recordMs\": {:.4f},\n  \"passes\": [",
+                        headlessFrames,
+                        _replaying ? _frameCapture.frame_count() : 0,
+                        _drawExtent.width, _drawExtent.height,
+                        frameTime / frames, recordTime / frames);
+  const char *separator = "";
+  for (const GpuProfiler::Zone &zone : _gpuProfiler.zones()) {
+    report << fmt::format("{}\n    {{\"name\": \"{}\", \"avgMs\": {:.4f}, "
+                          "\"minMs\": {:.4f}, \"maxMs\": {:.4f}",
+                          separator, zone.name, zone.average(), zone.min(),
+                          zone.max());
+    if (zone.hasStatistics) {
+      const GpuProfiler::PipelineStatistics &s = zone.statistics;
+      report << fmt::format(
+          ", \"inputVertices\": {}, \"vertexInvocations\": {}, "
+          "\"clippingPrimitives\": {}, \"fragmentInvocations\": {}, "
+          "\"computeInvocations\": {}",
+          s.inputVertices, s.vertexInvocations, s.clippingPrimitives,
+          s.fragmentInvocations, s.computeInvocations);
+    }
+    report << "}";
+    separator = ",";
+  }
+  report << "\n  ]\n}\n";
+  fmt::println("wrote {}", headlessReport);
+}
+
 void VulkanEngine::run() {
+  if (headless) {
+    run_headless();
+    return;
+  }
+
   SDL_Event e;
   bool bQuit = false;
   static bool skipDrawing = false;
   // main loop
   while (!bQuit) {
+    CPU_ZONE("frame");
+    // waits before input is read, so the wait does not add to the latency
+    limit_frame_rate();
+
+    auto start = std::chrono::system_clock::now();
+
     // Handle events on queue
     while (SDL_PollEvent(&e) != 0) {
       // close the window when user alt-f4s or clicks the X button
       if (e.type == SDL_QUIT)
         bQuit = true;
-      if (e.type == SDL_WINDOWEVENT_MINIMIZED) {
-        skipDrawing = true;
-      }
-      if (e.type == SDL_WINDOWEVENT_RESTORED) {
-        skipDrawing = false;
-      }
-      if (e.type == SDL_WINDOWEVENT_RESIZED) {
+      if (e.type == SDL_WINDOWEVENT) {
+        if (e.window.event == SDL_WINDOWEVENT_MINIMIZED) {
+          skipDrawing = true;
+        }
+        if (e.window.event == SDL_WINDOWEVENT_RESTORED) {
+          skipDrawing = false;
+        }
+        if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+          resize_requested = true;
+        }
       }
       ImGui_ImplSDL2_ProcessEvent(&e);
+
+      // key releases always go through, or a key held while imgui grabbed
+      // the keyboard would keep the camera moving
+      ImGuiIO &io = ImGui::GetIO();
+      bool imguiInput = (e.type == SDL_KEYDOWN && io.WantCaptureKeyboard) ||
+                        (e.type == SDL_MOUSEMOTION && io.WantCaptureMouse);
+      if (!imguiInput) {
+        mainCamera.process_sdl_event(e);
+      }
+    }
+    _inputTime = std::chrono::steady_clock::now();
+
+    if (!skipDrawing) {
+      apply_present_settings();
+    }
+    if (resize_requested && !skipDrawing) {
+      resize_swapchain();
     }
 
     // imgui new frame
@@ -626,13 +2020,253 @@ void VulkanEngine::run() {
       ImGui::End();
     }
 
-    ImGui::Render();
+    if (ImGui::Begin("stats")) {
+      const RenderTargetPool::Stats &targets = _renderTargets.stats();
+      ImGui::Text("render targets %u in %u blocks", targets.targets,
+                  targets.blocks);
+      ImGui::Text("target memory %.1f MiB, %.1f MiB saved by aliasing",
+                  targets.allocatedBytes / (1024.f * 1024.f),
+                  (targets.dedicatedBytes - targets.allocatedBytes) /
+                      (1024.f * 1024.f));
+      ImGui::Text("lazily allocated %.1f MiB",
+                  targets.lazyBytes / (1024.f * 1024.f));
+
+      ImGui::Text("frametime %.2f ms, scene update %.2f ms",
+                  stats.frametime, stats.sceneUpdateTime);
+      ImGui::Text("geometry recording %.3f ms, commands %.3f ms",
+                  stats.drawRecordTime, stats.commandRecordTime);
+      ImGui::SliderInt("record threads", &recordThreads, 1,
+                       MAX_RECORD_THREADS);
+      // only what the surface supports is offered
+      if (ImGui::BeginCombo("present mode", present_mode_name(presentMode))) {
+        for (VkPresentModeKHR mode : _supportedPresentModes) {
+          if (ImGui::Selectable(present_mode_name(mode),
+                                mode == presentMode)) {
+            presentMode = mode;
+          }
+        }
+        ImGui::EndCombo();
+      }
+      ImGui::SliderInt("frames in flight", &framesInFlight, 1,
+                       (int)FRAME_OVERLAP);
+      ImGui::SliderFloat("frame limit", &frameLimit, 0.f, 480.f, "%.0f fps");
+      if (_getCalibratedTimestamps) {
+        ImGui::Text("input to gpu complete %.2f ms, average %.2f ms",
+                    stats.inputToGpu, stats.inputToGpuAverage);
+      }
+      ImGui::Text("gpu %.2f ms at render scale %.3f", stats.gpuTime,
+                  renderScale);
+      if (ImGui::Checkbox("dynamic resolution", &useDynamicResolution)) {
+        dynamicResolution.reset();
+      }
+      if (useDynamicResolution) {
+        ImGui::SliderFloat("target gpu ms", &dynamicResolution.targetMs, 2.f,
+                           50.f);
+        ImGui::SliderFloat("min scale", &dynamicResolution.minScale, 0.25f,
+                           dynamicResolution.maxScale);
+        ImGui::SliderFloat("max scale", &dynamicResolution.maxScale,
+                           dynamicResolution.minScale, 1.f);
+        ImGui::Text("smoothed %.2f ms", dynamicResolution.smoothed_ms());
+      } else {
+        ImGui::SliderFloat("render scale", &renderScale, 0.25f, 1.f);
+      }
+      // fixed at startup, flip usePushDescriptors to compare the two
+      ImGui::Text("frame descriptors %s, %.3f ms",
+                  _pushDescriptors ? "pushed" : "pooled",
+                  stats.descriptorTime);
+
+      ImGui::SliderInt("stress cubes", &stressCubes, 0, 100000);
+      ImGui::Checkbox("instancing", &useInstancing);
+      ImGui::Checkbox("indirect draws", &useIndirectDraws);
+      if (_drawIndirectCount) {
+        ImGui::Checkbox("gpu culling", &useGpuCulling);
+        if (_occlusionCulling) {
+          ImGui::Checkbox("occlusion culling", &useOcclusionCulling);
+        }
+      }
+      ImGui::Checkbox("cpu culling", &useCpuCulling);
+      ImGui::Checkbox("depth prepass", &useDepthPrepass);
+      if (_bindlessMaterials) {
+        ImGui::Checkbox("bindless materials", &useBindless);
+        ImGui::Text("bindless %u textures, %u materials",
+                    _bindless.texture_count(), _bindless.material_count());
+      }
+      ImGui::Text("cpu culled %u in %.3f ms", stats.cpuCulled,
+                  stats.cpuCullTime);
+
+      // counters of the last recorded frame
+      const RecorderStats &binds = _recorder.stats();
+      ImGui::Text("objects %zu opaque, %zu transparent",
+                  mainDrawContext.OpaqueSurfaces.size(),
+                  mainDrawContext.TransparentSurfaces.size());
+      ImGui::Text("draws %u, indirect commands %u", binds.draws,
+                  binds.indirectCommands);
+      ImGui::Text("pipeline binds %u, %u skipped", binds.pipelineBinds,
+                  binds.pipelineBindsSkipped);
+      ImGui::Text("descriptor binds %u, %u skipped", binds.descriptorBinds,
+                  binds.descriptorBindsSkipped);
+      ImGui::Text("index buffer binds %u, %u skipped", binds.indexBufferBinds,
+                  binds.indexBufferBindsSkipped);
+      ImGui::Text("push constants %u, %u skipped", binds.pushConstants,
+                  binds.pushConstantsSkipped);
+
+      if (useGpuCulling) {
+        const CullStats &culling = stats.culling;
+        float total = std::max(culling.objects, 1u);
+        ImGui::Text("culling %u objects, drawn %u early, %u late",
+                    culling.objects, culling.drawnEarly, culling.drawnLate);
+        ImGui::Text("frustum culled %u (%.1f%%), occlusion culled %u (%.1f%%)",
+                    culling.frustumCulled,
+                    100.f * culling.frustumCulled / total,
+                    culling.occlusionCulled,
+                    100.f * culling.occlusionCulled / total);
+      }
+
+      DrawBenchmark &bench = drawBenchmark;
+      if (bench.running) {
+        ImGui::Text("benchmarking %d draws, %s",
+                    DrawBenchmark::DRAW_COUNTS[bench.config / 2],
+                    bench.config % 2 ? "indirect" : "direct");
+      } else if (!recordBenchmark.running &&
+                 ImGui::Button("benchmark draws")) {
+        bench.running = true;
+        bench.config = 0;
+        bench.frame = 0;
+        bench.accumulated = 0;
+        bench.savedStressCubes = stressCubes;
+        bench.savedInstancing = useInstancing;
+        bench.savedIndirect = useIndirectDraws;
+        bench.savedCpuCulling = useCpuCulling;
+      }
+      if (bench.hasResults) {
+        for (uint32_t i = 0; i < std::size(DrawBenchmark::DRAW_COUNTS); i++) {
+          ImGui::Text("%6d draws: direct %.3f ms, indirect %.3f ms",
+                      DrawBenchmark::DRAW_COUNTS[i], bench.results[i][0],
+                      bench.results[i][1]);
+        }
+      }
+
+      RecordBenchmark &recordBench = recordBenchmark;
+      if (recordBench.running) {
+        ImGui::Text("benchmarking recording on %d threads",
+                    RecordBenchmark::THREAD_COUNTS[recordBench.config]);
+      } else if (!bench.running && ImGui::Button("benchmark recording")) {
+        recordBench.running = true;
+        recordBench.config = 0;
+        recordBench.frame = 0;
+        recordBench.accumulated = 0;
+        recordBench.savedStressCubes = stressCubes;
+        recordBench.savedInstancing = useInstancing;
+        recordBench.savedCpuCulling = useCpuCulling;
+        recordBench.savedRecordThreads = recordThreads;
+      }
+      if (recordBench.hasResults) {
+        for (uint32_t i = 0; i < std::size(RecordBenchmark::THREAD_COUNTS);
+             i++) {
+          ImGui::Text("%2d threads: %.3f ms, %.2fx",
+                      RecordBenchmark::THREAD_COUNTS[i],
+                      recordBench.results[i],
+                      recordBench.results[0] / recordBench.results[i]);
+        }
+      }
+
+      if (ImGui::Button("benchmark cpu culling")) {
+        const cpucull::BenchmarkResult &result =
+            cullBenchmark.emplace(cpucull::run_benchmark(_jobs, 1000000));
+        fmt::println("cpu culling benchmark, {} objects, {} visible, avx2 {}",
+                     result.objects, result.visible,
+                     result.avx2 ? "available" : "not available");
+        fmt::println("spheres: scalar {:.3f} ms, avx2 {:.3f} ms",
+                     result.sphereScalar, result.sphereAvx2);
+        fmt::println("boxes: scalar {:.3f} ms, avx2 {:.3f} ms, {} threads "
+                     "{:.3f} ms",
+                     result.boxScalar, result.boxAvx2, _jobs.thread_count(),
+                     result.boxParallel);
+        if (result.mismatches > 0) {
+          fmt::println("{} results differ between avx2 and scalar",
+                       result.mismatches);
+        }
+      }
+      if (cullBenchmark) {
+        const cpucull::BenchmarkResult &result = *cullBenchmark;
+        ImGui::Text("%u objects, spheres: scalar %.3f ms, avx2 %.3f ms",
+                    result.objects, result.sphereScalar, result.sphereAvx2);
+        ImGui::Text("boxes: scalar %.3f ms, avx2 %.3f ms, threaded %.3f ms",
+                    result.boxScalar, result.boxAvx2, result.boxParallel);
+      }
+    }
+    ImGui::End();
+
+    if (ImGui::Begin("gpu profiler")) {
+      if (_cpuTraceFramesLeft > 0) {
+        ImGui::Text("tracing cpu, %d frames left", _cpuTraceFramesLeft);
+      } else if (ImGui::Button("trace cpu")) {
+        _cpuTraceFramesLeft = cpuTraceFrames;
+      }
+      ImGui::SameLine();
+      ImGui::SliderInt("traced frames", &cpuTraceFrames, 1, 1000);
+      // replays with --replay, headless
+      if (_captureFramesLeft > 0) {
+        ImGui::Text("capturing, %d frames left", _captureFramesLeft);
+      } else if (ImGui::Button("capture scene")) {
+        _frameCapture.begin(_windowExtent, renderScale, testMeshes);
+        _captureFramesLeft = std::max(captureFrames, 1);
+      }
+      ImGui::SameLine();
+      ImGui::SliderInt("captured frames", &captureFrames, 1, 1000);
+      ImGui::Separator();
+
+      if (!_gpuProfiler.enabled()) {
+        ImGui::Text("no gpu timestamps on this device");
+      }
+      if (_gpuProfiler.statistics_flags()) {
+        ImGui::Checkbox("pipeline statistics", &usePipelineStatistics);
+      }
+      // as many frames late as there are frames in flight
+      for (const GpuProfiler::Zone &zone : _gpuProfiler.zones()) {
+        ImGui::PushID(zone.name);
+        ImGui::Text("%-10s %6.3f ms, min %.3f avg %.3f max %.3f", zone.name,
+                    zone.last, zone.min(), zone.average(), zone.max());
+        // the ring starts at head once it has wrapped
+        int offset = zone.samples == GpuProfiler::HISTORY ? zone.head : 0;
+        ImGui::PlotLines("##history", zone.history, zone.samples, offset,
+                         nullptr, 0.f, zone.max() * 1.25f, ImVec2(0, 40));
+        if (usePipelineStatistics && zone.hasStatistics) {
+          const GpuProfiler::PipelineStatistics &s = zone.statistics;
+          ImGui::Text("vertices %llu, vertex shaders %llu",
+                      (unsigned long long)s.inputVertices,
+                      (unsigned long long)s.vertexInvocations);
+          ImGui::Text("clipping primitives %llu",
+                      (unsigned long long)s.clippingPrimitives);
+          ImGui::Text("fragment shaders %llu, compute shaders %llu",
+                      (unsigned long long)s.fragmentInvocations,
+                      (unsigned long long)s.computeInvocations);
+        }
+        ImGui::PopID();
+      }
+    }
+    ImGui::End();
+
+    {
+      CPU_ZONE("imgui render");
+      ImGui::Render();
+    }
+
+    update_draw_benchmark();
+    update_record_benchmark();
 
     if (!skipDrawing) {
       draw();
     } else {
       std::this_thread::sleep_for(std::chrono::milliseconds{100});
     }
+
+    auto end = std::chrono::system_clock::now();
+    auto elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    stats.frametime = elapsed.count() / 1000.f;
+
+    update_cpu_trace();
   }
 }
 
@@ -640,10 +2274,13 @@ void VulkanEngine::init_vulkan() {
   vkb::InstanceBuilder builder;
 
   // make the vulkan instance, with basic debug features
+  // headless leaves out the surface extensions, software implementations
+  // on machines without a display may not have them
   auto inst_ret = builder.set_app_name("Example Vulkan Application")
                       .request_validation_layers(bUseValidationLayers)
                       .use_default_debug_messenger()
                       .require_api_version(1, 3, 0)
+                      .set_headless(headless)
                       .build();
 
   vkb::Instance vkb_inst = inst_ret.value();
@@ -652,7 +2289,9 @@ void VulkanEngine::init_vulkan() {
   _instance = vkb_inst.instance;
   _debug_messenger = vkb_inst.debug_messenger;
 
-  SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
+  if (!headless) {
+    SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
+  }
 
   VkPhysicalDeviceVulkan13Features features{};
   features.dynamicRendering = true;
@@ -664,17 +2303,138 @@ void VulkanEngine::init_vulkan() {
 
   // use vkbootstrap to select a gpu.
   // We want a gpu that can write to the SDL surface and supports vulkan 1.2
+  // without a surface the selector does not ask for presentation support
+  // or the swapchain extension
   vkb::PhysicalDeviceSelector selector{vkb_inst};
-  vkb::PhysicalDevice physicalDevice = selector.set_minimum_version(1, 3)
-                                           .set_required_features_13(features)
-                                           .set_required_features_12(features12)
-                                           .set_surface(_surface)
-                                           .select()
-                                           .value();
+  selector.set_minimum_version(1, 3)
+      .set_required_features_13(features)
+      .set_required_features_12(features12);
+  if (!headless) {
+    selector.set_surface(_surface);
+  }
+  vkb::PhysicalDevice physicalDevice = selector.select().value();
 
   // physicalDevice.features.
   // create the final vulkan device
 
+  // the culling and bindless paths need vulkan 1.2 features that are
+  // optional, they are turned off on a gpu without them
+  VkPhysicalDeviceVulkan12Features supported12{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  VkPhysicalDeviceFeatures2 supported2{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &supported12};
+  vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &supported2);
+
+  // the gpu cull writes how many draws each indirect call makes
+  _drawIndirectCount = supported12.drawIndirectCount;
+  features12.drawIndirectCount = _drawIndirectCount;
+  if (!_drawIndirectCount) {
+    useGpuCulling = false;
+  }
+
+  // the depth pyramid is reduced with a min sampler, and the depth target
+  // is sampled in a depth only read layout between the cull phases
+  _occlusionCulling = supported12.samplerFilterMinmax &&
+                      supported12.separateDepthStencilLayouts;
+  features12.samplerFilterMinmax = supported12.samplerFilterMinmax;
+  features12.separateDepthStencilLayouts =
+      supported12.separateDepthStencilLayouts;
+  if (!_occlusionCulling) {
+    useOcclusionCulling = false;
+  }
+
+  // the bindless texture array is sized at runtime, written while frames
+  // are in flight and indexed per material
+  _bindlessMaterials = supported12.runtimeDescriptorArray &&
+                       supported12.descriptorBindingPartiallyBound &&
+                       supported12.descriptorBindingSampledImageUpdateAfterBind &&
+                       supported12.descriptorBindingUpdateUnusedWhilePending &&
+                       supported12.shaderSampledImageArrayNonUniformIndexing;
+  features12.runtimeDescriptorArray = _bindlessMaterials;
+  features12.descriptorBindingPartiallyBound = _bindlessMaterials;
+  features12.descriptorBindingSampledImageUpdateAfterBind = _bindlessMaterials;
+  features12.descriptorBindingUpdateUnusedWhilePending = _bindlessMaterials;
+  features12.shaderSampledImageArrayNonUniformIndexing = _bindlessMaterials;
+  if (!_bindlessMaterials) {
+    useBindless = false;
+  }
+
+  // the selector is asked again with the optional features this gpu has, so
+  // they end up in the device it builds. It picks the same gpu, every
+  // requirement added is one that gpu meets
+  selector.set_required_features_12(features12);
+  physicalDevice = selector.select().value();
+
+  // block compression is optional, turn it on wherever the gpu has it so ktx
+  // textures can stay compressed in vram
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice.physical_device,
+                              &supportedFeatures);
+  _textureCompressionBC = supportedFeatures.textureCompressionBC;
+  _textureCompressionASTC = supportedFeatures.textureCompressionASTC_LDR;
+  physicalDevice.features.textureCompressionBC = _textureCompressionBC;
+  physicalDevice.features.textureCompressionASTC_LDR = _textureCompressionASTC;
+
+  // without it every indirect call is limited to a single command
+  _multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  physicalDevice.features.multiDrawIndirect = _multiDrawIndirect;
+
+  // the geometry pass executes secondaries, so counting it needs the query
+  // inherited into them
+  _pipelineStatistics = supportedFeatures.pipelineStatisticsQuery &&
+                        supportedFeatures.inheritedQueries;
+  physicalDevice.features.pipelineStatisticsQuery = _pipelineStatistics;
+  physicalDevice.features.inheritedQueries = _pipelineStatistics;
+
+  // every graphics and compute queue can write timestamps
+  _gpuTimestamps = physicalDevice.properties.limits.timestampComputeAndGraphics;
+  _timestampPeriod = physicalDevice.properties.limits.timestampPeriod;
+
+  // latency is measured by reading the gpu clock next to the cpu clock,
+  // frames still get gpu times without it
+  bool calibratedTimestamps = false;
+  if (_gpuTimestamps && physicalDevice.enable_extension_if_present(
+                            VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+    auto getTimeDomains =
+        (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+            vkGetInstanceProcAddr(
+                _instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+    uint32_t domainCount = 0;
+    getTimeDomains(physicalDevice.physical_device, &domainCount, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    getTimeDomains(physicalDevice.physical_device, &domainCount,
+                   domains.data());
+    calibratedTimestamps =
+        std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) !=
+        domains.end();
+  }
+
+  uint32_t modeCount = 0;
+  if (!headless) {
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice.physical_device,
+                                              _surface, &modeCount, nullptr);
+  }
+  _supportedPresentModes.resize(modeCount);
+  if (!headless) {
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice.physical_device,
+                                              _surface, &modeCount,
+                                              _supportedPresentModes.data());
+  }
+  // fifo is the one mode every surface supports
+  if (!headless && std::find(_supportedPresentModes.begin(), _supportedPresentModes.end(),
+                presentMode) == _supportedPresentModes.end()) {
+    fmt::println("present mode {} is not supported, using fifo",
+                 (int)presentMode);
+    presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  }
+  _presentMode = presentMode;
+
+  // the per frame sets fall back to pool allocation without it
+  _pushDescriptors = usePushDescriptors &&
+                     physicalDevice.enable_extension_if_present(
+                         VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
   vkb::DeviceBuilder deviceBuilder{physicalDevice};
 
   vkb::Device vkbDevice = deviceBuilder.build().value();
@@ -683,6 +2443,18 @@ void VulkanEngine::init_vulkan() {
   _device = vkbDevice.device;
   _chosenGPU = physicalDevice.physical_device;
 
+  if (calibratedTimestamps) {
+    _getCalibratedTimestamps =
+        (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(
+            _device, "vkGetCalibratedTimestampsEXT");
+  }
+
+  if (_pushDescriptors) {
+    DescriptorWriter::cmdPushDescriptorSet =
+        (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(
+            _device, "vkCmdPushDescriptorSetKHR");
+  }
+
   // use vkbootstrap to get a Graphics queue
   _graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 
@@ -711,9 +2483,13 @@ void VulkanEngine::create_swapchain(uint32_t width, uint32_t height) {
           .set_desired_format(VkSurfaceFormatKHR{
               .format = _swapchainImageFormat,
               .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR})
-          // use vsync present mode
-          .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+          // checked against the surface beforehand, so this is what the
+          // swapchain gets
+          .set_desired_present_mode(_presentMode)
           .set_desired_extent(width, height)
+          // lets the driver hand over in-flight presents to the new
+          // swapchain, VK_NULL_HANDLE on the first build
+          .set_old_swapchain(_swapchain)
           .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
           .build()
           .value();
@@ -735,81 +2511,120 @@ void VulkanEngine::destroy_swapchain() {
 }
 
 void VulkanEngine::resize_swapchain() {
-  vkDeviceWaitIdle(_device);
-
-  destroy_swapchain();
-
+  CPU_ZONE("resize swapchain");
   int w, h;
   SDL_GetWindowSize(_window, &w, &h);
-  _windowExtent.width = w;
-  _windowExtent.height = h;
-
-  create_swapchain(_windowExtent.width, _windowExtent.height);
-
-  resize_requested = false;
-}
-
-void VulkanEngine::init_swapchain() {
-  create_swapchain(_windowExtent.width, _windowExtent.height);
-
-  // hardcoding the depth format to 32 bit float
-  _drawImage.imageFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-  _windowExtent;
-
-  // depth image size will match the window
-  VkExtent3D drawImageExtent = {_windowExtent.width, _windowExtent.height, 1};
-  _drawImage.imageExtent = drawImageExtent;
-
-  VkImageUsageFlags drawImageUsages{};
-  drawImageUsages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-  drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
-  drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
-  VkImageCreateInfo rimg_info = vkinit::image_create_info(
-      _drawImage.imageFormat, drawImageUsages, _drawImage.imageExtent);
+  if (w == 0 || h == 0) {
+    // minimized, keep the request around until there is something to draw
+    return;
+  }
+  _windowExtent.width = w;
+  _windowExtent.height = h;
 
-  // for the draw image, we want to allocate it from gpu local memory
-  VmaAllocationCreateInfo rimg_allocinfo = {};
-  rimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-  rimg_allocinfo.requiredFlags =
-      VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  // no device wait here. Frames that are still in flight keep using the old
+  // swapchain and render targets, which retire through the frame queue once
+  // those frames are done
+  VkSwapchainKHR oldSwapchain = _swapchain;
+  std::vector<VkImageView> oldViews = std::move(_swapchainImageViews);
 
-  // allocate and create the image
-  vmaCreateImage(_allocator, &rimg_info, &rimg_allocinfo, &_drawImage.image,
-                 &_drawImage.allocation, nullptr);
+  create_swapchain(_windowExtent.width, _windowExtent.height);
 
-  // build a image-view for the draw image to use for rendering
-  VkImageViewCreateInfo rview_info = vkinit::imageview_create_info(
-      _drawImage.imageFormat, _drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+  _frameDeletionQueue.push_function(
+      [this, oldSwapchain, oldViews]() {
+        for (VkImageView view : oldViews) {
+          vkDestroyImageView(_device, view, nullptr);
+        }
+        vkDestroySwapchainKHR(_device, oldSwapchain, nullptr);
+      },
+      _frameNumber);
 
-  VK_CHECK(
-      vkCreateImageView(_device, &rview_info, nullptr, &_drawImage.imageView));
+  // the render targets follow the swapchain size on the next draw()
 
-  _depthImage.imageFormat = VK_FORMAT_D32_SFLOAT;
-  _depthImage.imageExtent = drawImageExtent;
+  resize_requested = false;
+}
 
-  VkImageUsageFlags depthImageUsages{};
-  depthImageUsages |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+void VulkanEngine::init_swapchain() {
+  // headless the frame is the window size and never changes
+  if (headless) {
+    _swapchainExtent = _windowExtent;
+  } else {
+    create_swapchain(_windowExtent.width, _windowExtent.height);
+  }
 
-  VkImageCreateInfo dimg_info = vkinit::image_create_info(
-      _depthImage.imageFormat, depthImageUsages, drawImageExtent);
+  // declared once up front so the pipelines can read the target formats
+  declare_render_targets();
+}
 
-  // allocate and create the image
-  vmaCreateImage(_allocator, &dimg_info, &rimg_allocinfo, &_depthImage.image,
-                 &_depthImage.allocation, nullptr);
+bool VulkanEngine::declare_render_targets() {
+  VkExtent2D extent = _swapchainExtent;
+
+  _renderTargets.begin_frame();
+
+  // the pool may place targets with disjoint pass ranges in the same memory,
+  // so every target below is transitioned from VK_IMAGE_LAYOUT_UNDEFINED by
+  // the first pass that uses it each frame. The ranges overlap for now and
+  // nothing actually aliases
+
+  // only the two phase cull builds and reads a pyramid from the depth
+  bool occlusion = useGpuCulling && useOcclusionCulling;
+
+  // hardcoding the draw format to 16 bit float
+  _drawTarget = _renderTargets.request(
+      RenderTargetDesc{VK_FORMAT_R16G16B16A16_SFLOAT, extent,
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                           VK_IMAGE_USAGE_STORAGE_BIT |
+                           VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
+      PASS_BACKGROUND, PASS_PRESENT_COPY);
+
+  // hardcoding the depth format to 32 bit float. The depth pyramid is built
+  // from it between the geometry passes, and transparent surfaces test
+  // against it, after that it is dead and later passes can reuse its memory.
+  // Only the pyramid samples it, without one it stays a plain attachment
+  VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (occlusion) {
+    depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+  }
+  _depthTarget = _renderTargets.request(
+      RenderTargetDesc{VK_FORMAT_D32_SFLOAT, extent, depthUsage},
+      PASS_GEOMETRY, PASS_TRANSPARENT);
+
+  // power of two below the frame, so every level halves exactly and a texel
+  // of one level always covers 2x2 of the next finer one
+  _depthPyramidExtent = {std::bit_floor(extent.width),
+                         std::bit_floor(extent.height)};
+  RenderTargetDesc pyramidDesc{
+      VK_FORMAT_R32_SFLOAT, _depthPyramidExtent,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT};
+  pyramidDesc.mipLevels = vkutil::mip_level_count(_depthPyramidExtent);
+  // without the two phase cull the target is dead for the whole frame and not
+  // requested at all. The cull pass samples it from the early phase on, even
+  // if only the late phase reads anything meaningful from it
+  if (occlusion) {
+    _depthPyramidTarget =
+        _renderTargets.request(pyramidDesc, PASS_GEOMETRY, PASS_GEOMETRY_LATE);
+  }
 
-  // build a image-view for the draw image to use for rendering
-  VkImageViewCreateInfo dview_info = vkinit::imageview_create_info(
-      _depthImage.imageFormat, _depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT);
+  if (!_renderTargets.build(this)) {
+    return false;
+  }
 
-  VK_CHECK(
-      vkCreateImageView(_device, &dview_info, nullptr, &_depthImage.imageView));
+  _drawImage = _renderTargets.get(_drawTarget);
+  _depthImage = _renderTargets.get(_depthTarget);
+  _depthPyramid =
+      occlusion ? _renderTargets.get(_depthPyramidTarget) : AllocatedImage{};
 
-  // add to deletion queues
-  _mainDeletionQueue.push_function([=]() {
-    vkDestroyImageView(_device, _drawImage.imageView, nullptr);
-    vmaDestroyImage(_allocator, _drawImage.image, _drawImage.allocation);
-  });
+  for (VkImageView view : _depthPyramidMips) {
+    _frameDeletionQueue.push_image_view(view, _frameNumber);
+  }
+  _depthPyramidMips.resize(occlusion ? pyramidDesc.mipLevels : 0);
+  for (uint32_t level = 0; level < _depthPyramidMips.size(); level++) {
+    VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(
+        VK_FORMAT_R32_SFLOAT, _depthPyramid.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    viewInfo.subresourceRange.baseMipLevel = level;
+    VK_CHECK(vkCreateImageView(_device, &viewInfo, nullptr,
+                               &_depthPyramidMips[level]));
+  }
+  return true;
 }
 
 void VulkanEngine::init_commands() {
@@ -829,8 +2644,20 @@ void VulkanEngine::init_commands() {
 
     VK_CHECK(vkAllocateCommandBuffers(_device, &cmdAllocInfo,
                                       &_frames[i]._mainCommandBuffer));
+
+    // secondaries are reset with their whole pool once the frame is done
+    VkCommandPoolCreateInfo slotPoolInfo =
+        vkinit::command_pool_create_info(_graphicsQueueFamily, 0);
+    _frames[i]._recordSlots.resize(MAX_RECORD_THREADS);
+    for (RecordSlot &slot : _frames[i]._recordSlots) {
+      VK_CHECK(
+          vkCreateCommandPool(_device, &slotPoolInfo, nullptr, &slot.pool));
+    }
   }
 
+  _gpuProfiler.init(_device, FRAME_OVERLAP, _gpuTimestamps, _timestampPeriod,
+                    _pipelineStatistics);
+
   VK_CHECK(vkCreateCommandPool(_device, &commandPoolInfo, nullptr,
                                &_immCommandPool));
 
@@ -930,6 +2757,143 @@ void VulkanEngine::init_background_pipelines() {
   });
 }
 
+void VulkanEngine::init_cull_pipeline() {
+  VkPushConstantRange pushConstant{};
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(CullPushConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  // buffers are reached through addresses, the only descriptor is the depth
+  // pyramid
+  DescriptorLayoutBuilder builder;
+  builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  _cullDescriptorLayout = builder.build(
+      _device, VK_SHADER_STAGE_COMPUTE_BIT,
+      _pushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+                       : 0);
+
+  VkPipelineLayoutCreateInfo cullLayout = vkinit::pipeline_layout_create_info();
+  cullLayout.pSetLayouts = &_cullDescriptorLayout;
+  cullLayout.setLayoutCount = 1;
+  cullLayout.pPushConstantRanges = &pushConstant;
+  cullLayout.pushConstantRangeCount = 1;
+
+  VK_CHECK(vkCreatePipelineLayout(_device, &cullLayout, nullptr,
+                                  &_cullPipelineLayout));
+
+  VkShaderModule cullShader;
+  if (!vkutil::load_shader_module("shaders/spiv/cull.comp.spv", _device,
+                                  &cullShader)) {
+    fmt::print("Error when building the cull shader \n");
+  }
+
+  VkPipelineShaderStageCreateInfo stageinfo{};
+  stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stageinfo.pNext = nullptr;
+  stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  stageinfo.module = cullShader;
+  stageinfo.pName = "main";
+
+  VkComputePipelineCreateInfo computePipelineCreateInfo{};
+  computePipelineCreateInfo.sType =
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  computePipelineCreateInfo.pNext = nullptr;
+  computePipelineCreateInfo.layout = _cullPipelineLayout;
+  computePipelineCreateInfo.stage = stageinfo;
+
+  VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1,
+                                    &computePipelineCreateInfo, nullptr,
+                                    &_cullPipeline));
+
+  vkDestroyShaderModule(_device, cullShader, nullptr);
+  _mainDeletionQueue.push_function([&]() {
+    vkDestroyPipelineLayout(_device, _cullPipelineLayout, nullptr);
+    vkDestroyPipeline(_device, _cullPipeline, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _cullDescriptorLayout, nullptr);
+  });
+}
+
+void VulkanEngine::init_depth_reduce_pipeline() {
+  DescriptorLayoutBuilder builder;
+  builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  builder.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  _depthReduceDescriptorLayout = builder.build(
+      _device, VK_SHADER_STAGE_COMPUTE_BIT,
+      _pushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+                       : 0);
+
+  VkPushConstantRange pushConstant{};
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(DepthReducePushConstants);
+  pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo reduceLayout =
+      vkinit::pipeline_layout_create_info();
+  reduceLayout.pSetLayouts = &_depthReduceDescriptorLayout;
+  reduceLayout.setLayoutCount = 1;
+  reduceLayout.pPushConstantRanges = &pushConstant;
+  reduceLayout.pushConstantRangeCount = 1;
+
+  VK_CHECK(vkCreatePipelineLayout(_device, &reduceLayout, nullptr,
+                                  &_depthReducePipelineLayout));
+
+  VkShaderModule reduceShader;
+  if (!vkutil::load_shader_module("shaders/spiv/depth_reduce.comp.spv",
+                                  _device, &reduceShader)) {
+    fmt::print("Error when building the depth reduce shader \n");
+  }
+
+  VkPipelineShaderStageCreateInfo stageinfo{};
+  stageinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stageinfo.pNext = nullptr;
+  stageinfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  stageinfo.module = reduceShader;
+  stageinfo.pName = "main";
+
+  VkComputePipelineCreateInfo computePipelineCreateInfo{};
+  computePipelineCreateInfo.sType =
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  computePipelineCreateInfo.pNext = nullptr;
+  computePipelineCreateInfo.layout = _depthReducePipelineLayout;
+  computePipelineCreateInfo.stage = stageinfo;
+
+  VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1,
+                                    &computePipelineCreateInfo, nullptr,
+                                    &_depthReducePipeline));
+
+  vkDestroyShaderModule(_device, reduceShader, nullptr);
+
+  // depth is reversed, so min keeps the farthest depth of the footprint,
+  // which is what an occlusion test has to compare against
+  VkSamplerReductionModeCreateInfo reduction{
+      .sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO,
+      .reductionMode = VK_SAMPLER_REDUCTION_MODE_MIN};
+
+  // without min filtering there is no occlusion cull, the sampler only
+  // fills the binding of the single phase
+  VkSamplerCreateInfo sampl = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                               .pNext = _occlusionCulling ? &reduction
+                                                          : nullptr};
+  sampl.magFilter = VK_FILTER_LINEAR;
+  sampl.minFilter = VK_FILTER_LINEAR;
+  sampl.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sampl.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampl.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampl.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampl.minLod = 0.f;
+  sampl.maxLod = VK_LOD_CLAMP_NONE;
+
+  VK_CHECK(vkCreateSampler(_device, &sampl, nullptr, &_depthReduceSampler));
+
+  _mainDeletionQueue.push_function([&]() {
+    vkDestroySampler(_device, _depthReduceSampler, nullptr);
+    vkDestroyPipelineLayout(_device, _depthReducePipelineLayout, nullptr);
+    vkDestroyPipeline(_device, _depthReducePipeline, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _depthReduceDescriptorLayout,
+                                 nullptr);
+  });
+}
+
 void VulkanEngine::init_sync_structures() {
   // create syncronization structures
   // one fence to control when the gpu has finished rendering the frame,
@@ -957,6 +2921,7 @@ void VulkanEngine::init_sync_structures() {
 
 void VulkanEngine::immediate_submit(
     std::function<void(VkCommandBuffer cmd)> &&function) {
+  CPU_ZONE("immediate submit");
   VK_CHECK(vkResetFences(_device, 1, &_immFence));
   VK_CHECK(vkResetCommandBuffer(_immCommandBuffer, 0));
 
@@ -984,11 +2949,14 @@ void VulkanEngine::immediate_submit(
 void VulkanEngine::init_pipelines() {
   // COMPUTE PIPELINES
   init_background_pipelines();
+  init_cull_pipeline();
+  init_depth_reduce_pipeline();
 
   // GRAPHICS PIPELINES
   init_triangle_pipeline();
 
   init_mesh_pipeline();
+  init_depth_prepass_pipeline();
 
   metalRoughMaterial.build_pipelines(this);
 }
@@ -1128,6 +3096,52 @@ void VulkanEngine::init_mesh_pipeline() {
   });
 }
 
+void VulkanEngine::init_depth_prepass_pipeline() {
+  VkShaderModule prepassVertexShader;
+  if (!vkutil::load_shader_module("shaders/spiv/depth_prepass.vert.spv",
+                                  _device, &prepassVertexShader)) {
+    fmt::println("Error when building the depth pre-pass vertex shader");
+  }
+
+  // same push constants as the material pipelines, but only the scene set
+  VkPushConstantRange bufferRange{};
+  bufferRange.offset = 0;
+  bufferRange.size = sizeof(GPUInstancedPushConstants);
+  bufferRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info =
+      vkinit::pipeline_layout_create_info();
+  pipeline_layout_info.pPushConstantRanges = &bufferRange;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pSetLayouts = &_gpuSceneDataDescriptorLayout;
+  pipeline_layout_info.setLayoutCount = 1;
+  VK_CHECK(vkCreatePipelineLayout(_device, &pipeline_layout_info, nullptr,
+                                  &_depthPrepassPipelineLayout));
+
+  PipelineBuilder pipelineBuilder;
+  pipelineBuilder._pipelineLayout = _depthPrepassPipelineLayout;
+  // no fragment stage, depth comes straight from rasterization
+  pipelineBuilder.set_vertex_shader(prepassVertexShader);
+  pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+  // has to match the material pipelines or EQUAL fails on the back faces
+  pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+  pipelineBuilder.set_multisampling_none();
+  pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+
+  // depth only rendering, no color attachment
+  pipelineBuilder.set_depth_format(_depthImage.imageFormat);
+
+  _depthPrepassPipeline = pipelineBuilder.build_pipeline(_device);
+
+  vkDestroyShaderModule(_device, prepassVertexShader, nullptr);
+
+  _mainDeletionQueue.push_function([&]() {
+    vkDestroyPipelineLayout(_device, _depthPrepassPipelineLayout, nullptr);
+    vkDestroyPipeline(_device, _depthPrepassPipeline, nullptr);
+  });
+}
+
 void VulkanEngine::init_descriptors() {
   // create a descriptor pool that will hold 10 sets with 1 image each
   std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
@@ -1140,8 +3154,10 @@ void VulkanEngine::init_descriptors() {
   {
     DescriptorLayoutBuilder builder;
     builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-    _drawImageDescriptorLayout =
-        builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+    _drawImageDescriptorLayout = builder.build(
+        _device, VK_SHADER_STAGE_COMPUTE_BIT,
+        _pushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+                         : 0);
   }
   {
     DescriptorLayoutBuilder builder;
@@ -1152,20 +3168,23 @@ void VulkanEngine::init_descriptors() {
   {
     DescriptorLayoutBuilder builder;
     builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    // pushed per command buffer when the device can, never allocated then
     _gpuSceneDataDescriptorLayout = builder.build(
-        _device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        _device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        _pushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+                         : 0);
+  }
+  // one draw image set per frame slot, each written on the slot's first use
+  // after the draw image was reallocated
+  if (!_pushDescriptors) {
+    for (int i = 0; i < FRAME_OVERLAP; i++) {
+      _frames[i]._drawImageSet = globalDescriptorAllocator.allocate(
+          _device, _drawImageDescriptorLayout);
+    }
   }
-  // allocate a descriptor set for our draw image
-  _drawImageDescriptors =
-      globalDescriptorAllocator.allocate(_device, _drawImageDescriptorLayout);
-
-  {
-    DescriptorWriter writer;
-    writer.write_image(0, _drawImage.imageView, VK_NULL_HANDLE,
-                       VK_IMAGE_LAYOUT_GENERAL,
-                       VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
 
-    writer.update_set(_device, _drawImageDescriptors);
+  if (_bindlessMaterials) {
+    _bindless.init(this);
   }
 
   //> frame_desc
@@ -1183,6 +3202,11 @@ void VulkanEngine::init_descriptors() {
 
     _mainDeletionQueue.push_function(
         [&, i]() { _frames[i]._frameDescriptors.destroy_pools(_device); });
+
+    // rewritten every time the slot is used, it outlives every frame
+    _frames[i]._sceneDataBuffer =
+        create_buffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                      VMA_MEMORY_USAGE_CPU_TO_GPU);
   }
   //< frame_desc
 }
@@ -1215,16 +3239,23 @@ AllocatedBuffer VulkanEngine::create_buffer(size_t allocSize,
 AllocatedImage VulkanEngine::create_image(VkExtent3D size, VkFormat format,
                                           VkImageUsageFlags usage,
                                           bool mipmapped) {
+  uint32_t mipLevels = 1;
+  if (mipmapped) {
+    mipLevels = vkutil::mip_level_count(VkExtent2D{size.width, size.height});
+  }
+
+  return allocate_image(size, format, usage, mipLevels);
+}
+
+AllocatedImage VulkanEngine::allocate_image(VkExtent3D size, VkFormat format,
+                                            VkImageUsageFlags usage,
+                                            uint32_t mipLevels) {
   AllocatedImage newImage;
   newImage.imageFormat = format;
   newImage.imageExtent = size;
 
   VkImageCreateInfo img_info = vkinit::image_create_info(format, usage, size);
-  if (mipmapped) {
-    img_info.mipLevels = static_cast<uint32_t>(std::floor(
-                             std::log2(std::max(size.width, size.height)))) +
-                         1;
-  }
+  img_info.mipLevels = mipLevels;
 
   // always allocate images on dedicated GPU memory
   VmaAllocationCreateInfo allocinfo = {};
@@ -1260,7 +3291,15 @@ AllocatedImage VulkanEngine::create_image(void *data, VkExtent3D size,
                                           VkFormat format,
                                           VkImageUsageFlags usage,
                                           bool mipmapped) {
-  size_t data_size = size.depth * size.width * size.height * 4;
+  // the mip chain is built with linear blits, formats that cant do that only
+  // get their base level instead of a chain of undefined levels
+  if (mipmapped && !supports_linear_blit(format)) {
+    fmt::println("format {} cant be blitted, skipping mipmaps",
+                 string_VkFormat(format));
+    mipmapped = false;
+  }
+
+  size_t data_size = vkutil::image_level_size(format, size);
   AllocatedBuffer uploadbuffer = create_buffer(
       data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
 
@@ -1271,40 +3310,294 @@ AllocatedImage VulkanEngine::create_image(void *data, VkExtent3D size,
       usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
       mipmapped);
 
-  immediate_submit([&](VkCommandBuffer cmd) {
-    vkutil::transition_image(cmd, new_image.image, VK_IMAGE_LAYOUT_UNDEFINED,
-                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  PendingImageUpload upload{uploadbuffer, new_image, mipmapped};
+  upload.copies.push_back(level_copy_region(0, 0, size));
+  queue_image_upload(std::move(upload));
+
+  return new_image;
+}
+
+AllocatedImage VulkanEngine::create_image(const TextureData &texture,
+                                          VkImageUsageFlags usage,
+                                          uint32_t firstMip) {
+  // the levels are contiguous in the source, one memcpy covers them
+  size_t firstOffset = texture.levels[firstMip].offset;
+  size_t size = texture.data.size() - firstOffset;
+  AllocatedBuffer uploadbuffer = create_buffer(
+      size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+  memcpy(uploadbuffer.info.pMappedData, texture.data.data() + firstOffset,
+         size);
+
+  uint32_t levelCount = (uint32_t)texture.levels.size() - firstMip;
+  AllocatedImage new_image =
+      allocate_image(texture.levels[firstMip].extent, texture.format,
+                     usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT, levelCount);
+
+  // the levels come prebuilt, so every one of them is a plain copy
+  PendingImageUpload upload{uploadbuffer, new_image, false};
+  for (uint32_t i = 0; i < levelCount; i++) {
+    const TextureLevel &level = texture.levels[firstMip + i];
+    upload.copies.push_back(
+        level_copy_region(level.offset - firstOffset, i, level.extent));
+  }
+  queue_image_upload(std::move(upload));
+
+  return new_image;
+}
+
+std::optional<AllocatedImage>
+VulkanEngine::load_texture(std::filesystem::path filePath,
+                           VkImageUsageFlags usage) {
+  std::optional<TextureData> texture = load_texture_data(filePath);
+  if (!texture) {
+    return {};
+  }
+
+  return create_image(*texture, usage);
+}
+
+std::optional<TextureData>
+VulkanEngine::load_texture_data(std::filesystem::path filePath) {
+  std::optional<TextureData> texture = loadKtx2Texture(filePath);
+  if (!texture) {
+    return {};
+  }
+
+  if (!supports_sampled_format(texture->format)) {
+    std::optional<TextureData> decoded = decodeTextureToRgba8(*texture);
+    if (!decoded) {
+      fmt::println("{}: device cant sample {} and there is no cpu decoder",
+                    filePath.string(), string_VkFormat(texture->format));
+      return {};
+    }
+
+    fmt::println("{}: device cant sample {}, decoded to {}", filePath.string(),
+                 string_VkFormat(texture->format),
+                 string_VkFormat(decoded->format));
+    texture = std::move(decoded);
+  }
+
+  return texture;
+}
+
+std::optional<uint32_t>
+VulkanEngine::load_streamed_texture(std::filesystem::path filePath) {
+  std::optional<TextureData> texture = load_texture_data(filePath);
+  if (!texture) {
+    return {};
+  }
+
+  return _textureStreamer.add_texture(this, std::move(*texture));
+}
+
+void VulkanEngine::register_streamed_material(
+    MaterialInstance *instance, MaterialPass pass,
+    const GLTFMetallic_Roughness::MaterialResources &resources,
+    uint32_t colorTexture, uint32_t metalRoughTexture) {
+  StreamedMaterial material{instance, pass, resources, colorTexture,
+                            metalRoughTexture};
+
+  if (colorTexture != TextureStreamer::INVALID_TEXTURE) {
+    material.resources.colorImage =
+        _textureStreamer.textures[colorTexture].image;
+  }
+  if (metalRoughTexture != TextureStreamer::INVALID_TEXTURE) {
+    material.resources.metalRoughImage =
+        _textureStreamer.textures[metalRoughTexture].image;
+  }
+
+  *instance = metalRoughMaterial.write_material(
+      _device, pass, material.resources, globalDescriptorAllocator);
+  // the whole ring is allocated up front, changes only ever rewrite it
+  material.sets[0] = instance->materialSet;
+  for (uint32_t i = 1; i < FRAME_OVERLAP; i++) {
+    material.sets[i] = globalDescriptorAllocator.allocate(
+        _device, metalRoughMaterial.materialLayout);
+  }
+  material.currentSet = 0;
+
+  _streamedMaterialLookup[instance] = (uint32_t)_streamedMaterials.size();
+  _streamedMaterials.push_back(material);
+}
+
+void VulkanEngine::request_texture_footprints() {
+  if (_streamedMaterials.empty()) {
+    return;
+  }
+
+  float viewportHeight = _windowExtent.height * renderScale;
+  float projScale = std::abs(sceneData.proj[1][1]);
+
+  auto request_footprint = [&](const RenderObject &draw) {
+    auto it = _streamedMaterialLookup.find(draw.material);
+    if (it == _streamedMaterialLookup.end()) {
+      return;
+    }
+
+    // project the bounding sphere, its diameter in pixels is the footprint
+    glm::vec4 center =
+        sceneData.view * draw.transform * glm::vec4(draw.bounds.origin, 1.f);
+    float scale = std::max({glm::length(glm::vec3(draw.transform[0])),
+                            glm::length(glm::vec3(draw.transform[1])),
+                            glm::length(glm::vec3(draw.transform[2]))});
+    float radius = draw.bounds.sphereRadius * scale;
+    float depth = std::max(-center.z, 0.1f);
+    float pixels = radius / depth * projScale * viewportHeight;
+
+    const StreamedMaterial &material = _streamedMaterials[it->second];
+    _textureStreamer.request(material.colorTexture, pixels);
+    _textureStreamer.request(material.metalRoughTexture, pixels);
+  };
+
+  for (const RenderObject &draw : mainDrawContext.OpaqueSurfaces) {
+    request_footprint(draw);
+  }
+  for (const RenderObject &draw : mainDrawContext.TransparentSurfaces) {
+    request_footprint(draw);
+  }
+}
+
+void VulkanEngine::refresh_streamed_materials() {
+  if (_textureStreamer.changed.empty()) {
+    return;
+  }
+
+  auto was_changed = [&](uint32_t texture) {
+    return texture != TextureStreamer::INVALID_TEXTURE &&
+           std::find(_textureStreamer.changed.begin(),
+                     _textureStreamer.changed.end(),
+                     texture) != _textureStreamer.changed.end();
+  };
+
+  for (StreamedMaterial &material : _streamedMaterials) {
+    if (!was_changed(material.colorTexture) &&
+        !was_changed(material.metalRoughTexture)) {
+      continue;
+    }
+
+    if (material.colorTexture != TextureStreamer::INVALID_TEXTURE) {
+      material.resources.colorImage =
+          _textureStreamer.textures[material.colorTexture].image;
+    }
+    if (material.metalRoughTexture != TextureStreamer::INVALID_TEXTURE) {
+      material.resources.metalRoughImage =
+          _textureStreamer.textures[material.metalRoughTexture].image;
+    }
+
+    material.currentSet = (material.currentSet + 1) % FRAME_OVERLAP;
+    VkDescriptorSet set = material.sets[material.currentSet];
+    metalRoughMaterial.update_material_set(_device, set, material.resources);
+    material.instance->materialSet = set;
+    metalRoughMaterial.update_bindless(*material.instance, material.resources,
+                                       _frameNumber);
+  }
+}
+
+VkBufferImageCopy VulkanEngine::level_copy_region(VkDeviceSize bufferOffset,
+                                                  uint32_t mipLevel,
+                                                  VkExtent3D extent) {
+  VkBufferImageCopy copyRegion = {};
+  copyRegion.bufferOffset = bufferOffset;
+  copyRegion.bufferRowLength = 0;
+  copyRegion.bufferImageHeight = 0;
+
+  copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  copyRegion.imageSubresource.mipLevel = mipLevel;
+  copyRegion.imageSubresource.baseArrayLayer = 0;
+  copyRegion.imageSubresource.layerCount = 1;
+  copyRegion.imageExtent = extent;
+
+  return copyRegion;
+}
+
+void VulkanEngine::queue_image_upload(PendingImageUpload &&upload) {
+  _pendingImageUploads.push_back(std::move(upload));
+
+  // outside of a batch every image gets its own submit
+  if (_imageUploadBatches == 0) {
+    flush_image_uploads();
+  }
+}
+
+void VulkanEngine::begin_image_uploads() { _imageUploadBatches++; }
+
+void VulkanEngine::end_image_uploads() {
+  if (--_imageUploadBatches == 0) {
+    flush_image_uploads();
+  }
+}
 
-    VkBufferImageCopy copyRegion = {};
-    copyRegion.bufferOffset = 0;
-    copyRegion.bufferRowLength = 0;
-    copyRegion.bufferImageHeight = 0;
+void VulkanEngine::flush_image_uploads() {
+  if (_pendingImageUploads.empty()) {
+    return;
+  }
+  CPU_ZONE("image uploads");
 
-    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copyRegion.imageSubresource.mipLevel = 0;
-    copyRegion.imageSubresource.baseArrayLayer = 0;
-    copyRegion.imageSubresource.layerCount = 1;
-    copyRegion.imageExtent = size;
+  // record every pending copy and mip chain into a single submit
+  immediate_submit([&](VkCommandBuffer cmd) {
+    for (PendingImageUpload &upload : _pendingImageUploads) {
+      AllocatedImage &image = upload.image;
 
-    // copy the buffer into the image
-    vkCmdCopyBufferToImage(cmd, uploadbuffer.buffer, new_image.image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                           &copyRegion);
+      vkutil::transition_image(cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-    vkutil::transition_image(cmd, new_image.image,
+      // copy the buffer into the image
+      vkCmdCopyBufferToImage(cmd, upload.staging.buffer, image.image,
                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                             (uint32_t)upload.copies.size(),
+                             upload.copies.data());
+
+      if (upload.mipmapped) {
+        vkutil::generate_mipmaps(
+            cmd, image.image,
+            VkExtent2D{image.imageExtent.width, image.imageExtent.height});
+      } else {
+        vkutil::transition_image(cmd, image.image,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+      }
+    }
   });
 
-  destroy_buffer(uploadbuffer);
+  for (PendingImageUpload &upload : _pendingImageUploads) {
+    destroy_buffer(upload.staging);
+  }
+  _pendingImageUploads.clear();
+}
+
+bool VulkanEngine::supports_linear_blit(VkFormat format) {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(_chosenGPU, format, &properties);
 
-  return new_image;
+  VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                  VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (properties.optimalTilingFeatures & required) == required;
+}
+
+bool VulkanEngine::supports_sampled_format(VkFormat format) {
+  // compressed formats also need their device feature turned on
+  if (vkutil::is_bc_format(format) && !_textureCompressionBC) {
+    return false;
+  }
+  if (vkutil::is_astc_format(format) && !_textureCompressionASTC) {
+    return false;
+  }
+
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(_chosenGPU, format, &properties);
+
+  return (properties.optimalTilingFeatures &
+          VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
 }
 //< upload_image
 GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
                                         std::span<Vertex> vertices) {
+  CPU_ZONE("upload mesh");
   const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
   const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+  const size_t positionBufferSize = vertices.size() * sizeof(glm::vec3);
 
   GPUMeshBuffers newSurface;
 
@@ -1322,15 +3615,24 @@ GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
   newSurface.vertexBufferAddress =
       vkGetBufferDeviceAddress(_device, &deviceAdressInfo);
 
+  // positions again on their own for the depth pre-pass
+  newSurface.positionBuffer = create_buffer(
+      positionBufferSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+  newSurface.positionBufferAddress =
+      get_buffer_address(newSurface.positionBuffer);
+
   // create index buffer
   newSurface.indexBuffer = create_buffer(indexBufferSize,
                                          VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
                                              VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                          VMA_MEMORY_USAGE_GPU_ONLY);
 
-  AllocatedBuffer staging = create_buffer(vertexBufferSize + indexBufferSize,
-                                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                          VMA_MEMORY_USAGE_CPU_ONLY);
+  AllocatedBuffer staging = create_buffer(
+      vertexBufferSize + indexBufferSize + positionBufferSize,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
 
   void *data = staging.allocation->GetMappedData();
 
@@ -1338,6 +3640,12 @@ GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
   memcpy(data, vertices.data(), vertexBufferSize);
   // copy index buffer
   memcpy((char *)data + vertexBufferSize, indices.data(), indexBufferSize);
+  // copy positions
+  glm::vec3 *positions =
+      (glm::vec3 *)((char *)data + vertexBufferSize + indexBufferSize);
+  for (size_t i = 0; i < vertices.size(); i++) {
+    positions[i] = vertices[i].position;
+  }
 
   immediate_submit([&](VkCommandBuffer cmd) {
     VkBufferCopy vertexCopy{0};
@@ -1355,6 +3663,14 @@ GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
 
     vkCmdCopyBuffer(cmd, staging.buffer, newSurface.indexBuffer.buffer, 1,
                     &indexCopy);
+
+    VkBufferCopy positionCopy{0};
+    positionCopy.dstOffset = 0;
+    positionCopy.srcOffset = vertexBufferSize + indexBufferSize;
+    positionCopy.size = positionBufferSize;
+
+    vkCmdCopyBuffer(cmd, staging.buffer, newSurface.positionBuffer.buffer, 1,
+                    &positionCopy);
   });
 
   destroy_buffer(staging);
@@ -1364,22 +3680,18 @@ GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
 void VulkanEngine::destroy_buffer(const AllocatedBuffer &buffer) {
   vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
 }
-void GLTFMetallic_Roughness::build_pipelines(VulkanEngine *engine) {
-  VkShaderModule meshFragShader;
-  if (!vkutil::load_shader_module("shaders/spiv/mesh.frag.spv", engine->_device,
-                                  &meshFragShader)) {
-    fmt::println("Error when building the triangle fragment shader module");
-  }
 
-  VkShaderModule meshVertexShader;
-  if (!vkutil::load_shader_module("shaders/spiv/mesh.vert.spv", engine->_device,
-                                  &meshVertexShader)) {
-    fmt::println("Error when building the triangle vertex shader module");
-  }
+void VulkanEngine::destroy_image(const AllocatedImage &image) {
+  vkDestroyImageView(_device, image.imageView, nullptr);
+  vmaDestroyImage(_allocator, image.image, image.allocation);
+}
+void GLTFMetallic_Roughness::build_pipelines(VulkanEngine *engine) {
+  // materials skip the bindless table on a gpu without the bindless path
+  bindless = engine->_bindlessMaterials ? &engine->_bindless : nullptr;
 
   VkPushConstantRange matrixRange{};
   matrixRange.offset = 0;
-  matrixRange.size = sizeof(GPUDrawPushConstants);
+  matrixRange.size = sizeof(GPUInstancedPushConstants);
   matrixRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
   DescriptorLayoutBuilder layoutBuilder;
@@ -1391,61 +3703,95 @@ void GLTFMetallic_Roughness::build_pipelines(VulkanEngine *engine) {
       layoutBuilder.build(engine->_device, VK_SHADER_STAGE_VERTEX_BIT |
                                                VK_SHADER_STAGE_FRAGMENT_BIT);
 
-  VkDescriptorSetLayout layouts[] = {engine->_gpuSceneDataDescriptorLayout,
-                                     materialLayout};
+  // opaque, depth equal and transparent pipelines of one shader pair, all
+  // sharing a layout with the scene in set 0 and the material in set 1
+  auto build_variants = [&](const char *vertexPath, const char *fragmentPath,
+                            VkDescriptorSetLayout materialSetLayout,
+                            MaterialPipeline &opaque,
+                            MaterialPipeline &transparent) {
+    VkShaderModule meshFragShader;
+    if (!vkutil::load_shader_module(fragmentPath, engine->_device,
+                                    &meshFragShader)) {
+      fmt::println("Error when building the triangle fragment shader module");
+    }
 
-  VkPipelineLayoutCreateInfo mesh_layout_info =
-      vkinit::pipeline_layout_create_info();
-  mesh_layout_info.setLayoutCount = 2;
-  mesh_layout_info.pSetLayouts = layouts;
-  mesh_layout_info.pPushConstantRanges = &matrixRange;
-  mesh_layout_info.pushConstantRangeCount = 1;
+    VkShaderModule meshVertexShader;
+    if (!vkutil::load_shader_module(vertexPath, engine->_device,
+                                    &meshVertexShader)) {
+      fmt::println("Error when building the triangle vertex shader module");
+    }
 
-  VkPipelineLayout newLayout;
-  VK_CHECK(vkCreatePipelineLayout(engine->_device, &mesh_layout_info, nullptr,
-                                  &newLayout));
+    VkDescriptorSetLayout layouts[] = {engine->_gpuSceneDataDescriptorLayout,
+                                       materialSetLayout};
 
-  opaquePipeline.layout = newLayout;
-  transparentPipeline.layout = newLayout;
+    VkPipelineLayoutCreateInfo mesh_layout_info =
+        vkinit::pipeline_layout_create_info();
+    mesh_layout_info.setLayoutCount = 2;
+    mesh_layout_info.pSetLayouts = layouts;
+    mesh_layout_info.pPushConstantRanges = &matrixRange;
+    mesh_layout_info.pushConstantRangeCount = 1;
 
-  // build the stage-create-info for both vertex and fragment stages. This lets
-  // the pipeline know the shader modules per stage
-  PipelineBuilder pipelineBuilder;
+    VkPipelineLayout newLayout;
+    VK_CHECK(vkCreatePipelineLayout(engine->_device, &mesh_layout_info,
+                                    nullptr, &newLayout));
 
-  pipelineBuilder.set_shaders(meshVertexShader, meshFragShader);
+    opaque.layout = newLayout;
+    transparent.layout = newLayout;
 
-  pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    // build the stage-create-info for both vertex and fragment stages. This
+    // lets the pipeline know the shader modules per stage
+    PipelineBuilder pipelineBuilder;
 
-  pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+    pipelineBuilder.set_shaders(meshVertexShader, meshFragShader);
 
-  pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+    pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 
-  pipelineBuilder.set_multisampling_none();
+    pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
 
-  pipelineBuilder.disable_blending();
+    pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
 
-  pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+    pipelineBuilder.set_multisampling_none();
 
-  // render format
-  pipelineBuilder.set_color_attachment_format(engine->_drawImage.imageFormat);
-  pipelineBuilder.set_depth_format(engine->_depthImage.imageFormat);
+    pipelineBuilder.disable_blending();
 
-  // use the triangle layout we created
-  pipelineBuilder._pipelineLayout = newLayout;
+    pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
 
-  // finally build the pipeline
-  opaquePipeline.pipeline = pipelineBuilder.build_pipeline(engine->_device);
+    // render format
+    pipelineBuilder.set_color_attachment_format(
+        engine->_drawImage.imageFormat);
+    pipelineBuilder.set_depth_format(engine->_depthImage.imageFormat);
+
+    // use the triangle layout we created
+    pipelineBuilder._pipelineLayout = newLayout;
+
+    // finally build the pipeline
+    opaque.pipeline = pipelineBuilder.build_pipeline(engine->_device);
+
+    // variant for after the depth pre-pass, only the visible surface passes
+    pipelineBuilder.enable_depthtest(false, VK_COMPARE_OP_EQUAL);
+    opaque.depthEqualPipeline =
+        pipelineBuilder.build_pipeline(engine->_device);
+
+    // create the transparent variant
+    pipelineBuilder.enable_blending_additive();
 
-  // create the transparent variant
-  pipelineBuilder.enable_blending_additive();
+    pipelineBuilder.enable_depthtest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
 
-  pipelineBuilder.enable_depthtest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
+    transparent.pipeline = pipelineBuilder.build_pipeline(engine->_device);
+    // transparent surfaces dont write depth, so the pre-pass leaves them out
+    transparent.depthEqualPipeline = VK_NULL_HANDLE;
 
-  transparentPipeline.pipeline =
-      pipelineBuilder.build_pipeline(engine->_device);
+    vkDestroyShaderModule(engine->_device, meshFragShader, nullptr);
+    vkDestroyShaderModule(engine->_device, meshVertexShader, nullptr);
+  };
 
-  vkDestroyShaderModule(engine->_device, meshFragShader, nullptr);
-  vkDestroyShaderModule(engine->_device, meshVertexShader, nullptr);
+  build_variants("shaders/spiv/mesh.vert.spv", "shaders/spiv/mesh.frag.spv",
+                 materialLayout, opaquePipeline, transparentPipeline);
+  if (bindless) {
+    build_variants("shaders/spiv/mesh_bindless.vert.spv",
+                   "shaders/spiv/mesh_bindless.frag.spv", bindless->layout(),
+                   bindlessOpaquePipeline, bindlessTransparentPipeline);
+  }
 }
 
 void GLTFMetallic_Roughness::clear_resources(VkDevice device) {}
@@ -1458,12 +3804,34 @@ MaterialInstance GLTFMetallic_Roughness::write_material(
   matData.passType = pass;
   if (pass == MaterialPass::Transparent) {
     matData.pipeline = &transparentPipeline;
+    matData.bindlessPipeline = &bindlessTransparentPipeline;
   } else {
     matData.pipeline = &opaquePipeline;
+    matData.bindlessPipeline = &bindlessOpaquePipeline;
+  }
+
+  matData.materialSet =
+      write_material_set(device, resources, descriptorAllocator);
+  if (bindless) {
+    matData.materialIndex =
+        bindless->add_material(acquire_bindless(resources));
   }
 
-  matData.materialSet = descriptorAllocator.allocate(device, materialLayout);
+  return matData;
+}
+
+VkDescriptorSet GLTFMetallic_Roughness::write_material_set(
+    VkDevice device, const MaterialResources &resources,
+    DescriptorAllocatorGrowable &descriptorAllocator) {
+  VkDescriptorSet materialSet =
+      descriptorAllocator.allocate(device, materialLayout);
+  update_material_set(device, materialSet, resources);
+  return materialSet;
+}
 
+void GLTFMetallic_Roughness::update_material_set(
+    VkDevice device, VkDescriptorSet materialSet,
+    const MaterialResources &resources) {
   writer.clear();
   writer.write_buffer(0, resources.dataBuffer, sizeof(MaterialConstants),
                       resources.dataBufferOffset,
@@ -1476,9 +3844,33 @@ MaterialInstance GLTFMetallic_Roughness::write_material(
                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
-  writer.update_set(device, matData.materialSet);
+  writer.update_set(device, materialSet);
+}
 
-  return matData;
+GPUMaterialData
+GLTFMetallic_Roughness::acquire_bindless(const MaterialResources &resources) {
+  GPUMaterialData data{};
+  data.colorFactors = resources.colorFactors;
+  data.metal_rough_factors = resources.metalRoughFactors;
+  data.colorTexture = bindless->acquire_texture(
+      resources.colorImage.imageView, resources.colorSampler);
+  data.metalRoughTexture = bindless->acquire_texture(
+      resources.metalRoughImage.imageView, resources.metalRoughSampler);
+  return data;
+}
+
+void GLTFMetallic_Roughness::update_bindless(const MaterialInstance &material,
+                                             const MaterialResources &resources,
+                                             int frameNumber) {
+  if (!bindless) {
+    return;
+  }
+  // acquire before releasing, so slots both versions share stay put
+  GPUMaterialData previous = bindless->material(material.materialIndex);
+  bindless->update_material(material.materialIndex,
+                            acquire_bindless(resources));
+  bindless->release_texture(previous.colorTexture, frameNumber);
+  bindless->release_texture(previous.metalRoughTexture, frameNumber);
 }
 //< write_mat
 //> meshdraw
@@ -1491,11 +3883,17 @@ void MeshNode::Draw(const glm::mat4 &topMatrix, DrawContext &ctx) {
     def.firstIndex = s.startIndex;
     def.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
     def.material = &s.material->data;
+    def.bounds = s.bounds;
 
     def.transform = nodeMatrix;
     def.vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress;
+    def.positionBufferAddress = mesh->meshBuffers.positionBufferAddress;
 
-    ctx.OpaqueSurfaces.push_back(def);
+    if (def.material->passType == MaterialPass::Transparent) {
+      ctx.TransparentSurfaces.push_back(def);
+    } else {
+      ctx.OpaqueSurfaces.push_back(def);
+    }
   }
 
   // recurse down
@@ -1,11 +1,26 @@
 ﻿#pragma once
 
 #include "../thirdparty/Vma/vk_mem_alloc.h"
+#include "loader/vk_ktx.h"
 #include "loader/vk_loader.h"
+#include "vk_bindless.h"
+#include "vk_command_recorder.h"
+#include "vk_cpu_profiler.h"
+#include "vk_culling.h"
+#include "vk_deletion_queue.h"
 #include "vk_descriptors.h"
+#include "vk_draw_sort.h"
+#include "vk_frame_capture.h"
+#include "vk_dynamic_resolution.h"
+#include "vk_gpu_profiler.h"
+#include "vk_jobs.h"
+#include "vk_render_targets.h"
+#include "vk_texture_streaming.h"
 #include "vk_types.h"
 #include "vulkan/vulkan_core.h"
 
+#include <chrono>
+
 class VulkanEngine;
 
 struct DeletionQueue {
@@ -25,26 +40,140 @@ struct DeletionQueue {
   }
 };
 
+// command pool of one recording thread. Pools cant be used from two threads
+// at once, so every chunk of a multithreaded pass records through its own
+struct RecordSlot {
+  VkCommandPool pool;
+  // secondaries allocated so far, the first used of them are taken this frame
+  std::vector<VkCommandBuffer> buffers;
+  uint32_t used{0};
+  CommandRecorder recorder;
+};
+
 struct FrameData {
   VkSemaphore _swapchainSemaphore, _renderSemaphore;
   VkFence _renderFence;
 
   VkCommandPool _commandPool;
   VkCommandBuffer _mainCommandBuffer;
+  std::vector<RecordSlot> _recordSlots;
 
-  DeletionQueue _deletionQueue;
   DescriptorAllocatorGrowable _frameDescriptors;
+  // the background's draw image set, rewritten once the slot is reused after
+  // the draw image changed. Unused when descriptors are pushed
+  VkDescriptorSet _drawImageSet{VK_NULL_HANDLE};
+  uint32_t _drawImageSetVersion{0};
+  // scene uniforms, mapped
+  AllocatedBuffer _sceneDataBuffer{};
+
+  // instance data and indirect commands of this frame's draws, grown when a
+  // frame needs more
+  AllocatedBuffer _instanceBuffer{};
+  VkDeviceAddress _instanceBufferAddress{0};
+  AllocatedBuffer _indirectBuffer{};
+
+  // gpu culling reads the objects and compacts the survivors into the
+  // culled commands, counting them per indirect call
+  AllocatedBuffer _cullObjectBuffer{};
+  AllocatedBuffer _culledDrawBuffer{};
+  AllocatedBuffer _drawCountBuffer{};
+  // the counts copied back for the stats window, read once this frame's
+  // fence has signaled again. Zero groups when nothing was copied
+  AllocatedBuffer _cullStatsBuffer{};
+  uint32_t _cullStatsGroups{0};
+
+  // when the input this frame reacted to was read
+  std::chrono::steady_clock::time_point _inputTime;
 };
 
-constexpr unsigned int FRAME_OVERLAP = 2;
+// what the gpu culling did in the last frame that was read back
+struct CullStats {
+  uint32_t objects;
+  // drawn because they were visible the frame before
+  uint32_t drawnEarly;
+  // newly visible after testing against this frame's depth pyramid
+  uint32_t drawnLate;
+  uint32_t frustumCulled;
+  uint32_t occlusionCulled;
+};
 
-struct ComputePushConstants {
-  glm::vec4 data1;
-  glm::vec4 data2;
-  glm::vec4 data3;
-  glm::vec4 data4;
+struct EngineStats {
+  float frametime;
+  float sceneUpdateTime;
+  // cpu time spent sorting, batching and recording the geometry pass
+  float drawRecordTime;
+  // the command recording part of drawRecordTime
+  float commandRecordTime;
+  CullStats culling;
+  // cpu frustum culling in update_scene
+  float cpuCullTime;
+  uint32_t cpuCulled;
+  // cpu time spent allocating, writing and pushing the per frame sets, and
+  // resetting their pools
+  float descriptorTime;
+  // gpu time of the render scaled part of the frame, background and
+  // geometry, from the last frame that was read back
+  float gpuTime;
+  // from reading input to the gpu finishing the frame that reacts to it,
+  // the last frame read back and averaged over recent frames. Zero without
+  // calibrated timestamps. It stops before the present, so the time a frame
+  // waits in the swapchain, where fifo and mailbox differ, is not part of it
+  float inputToGpu;
+  float inputToGpuAverage;
 };
 
+// measures the cpu cost of draw_geometry with direct and indirect drawing at
+// a few draw counts. Instancing is off while it runs, so every cube is its
+// own draw
+struct DrawBenchmark {
+  static constexpr int DRAW_COUNTS[] = {1000, 10000, 100000};
+  static constexpr uint32_t CONFIG_COUNT = std::size(DRAW_COUNTS) * 2;
+  static constexpr uint32_t WARMUP_FRAMES = 30;
+  static constexpr uint32_t MEASURE_FRAMES = 120;
+
+  bool running{false};
+  bool hasResults{false};
+  // draw count index * 2, plus 1 for indirect
+  uint32_t config;
+  uint32_t frame;
+  double accumulated;
+  // average ms per frame, [count][indirect]
+  float results[std::size(DRAW_COUNTS)][2];
+
+  // settings to restore afterwards
+  int savedStressCubes;
+  bool savedInstancing;
+  bool savedIndirect;
+  bool savedCpuCulling;
+};
+
+// records geometry command recording time at a fixed draw count with more
+// and more recording threads
+struct RecordBenchmark {
+  static constexpr int THREAD_COUNTS[] = {1, 2, 4, 8, 16};
+  static constexpr int DRAWS = 50000;
+  static constexpr uint32_t WARMUP_FRAMES = 30;
+  static constexpr uint32_t MEASURE_FRAMES = 120;
+
+  bool running{false};
+  bool hasResults{false};
+  uint32_t config;
+  uint32_t frame;
+  double accumulated;
+  // average ms of command recording per frame, per thread count
+  float results[std::size(THREAD_COUNTS)];
+
+  // settings to restore afterwards
+  int savedStressCubes;
+  bool savedInstancing;
+  bool savedCpuCulling;
+  int savedRecordThreads;
+};
+
+// frame slots there are, framesInFlight of them are used
+constexpr unsigned int FRAME_OVERLAP = 3;
+constexpr uint32_t MAX_RECORD_THREADS = 16;
+
 struct ComputeEffect {
   const char *name;
 
@@ -58,8 +187,12 @@ struct ComputeEffect {
 struct GLTFMetallic_Roughness {
   MaterialPipeline opaquePipeline;
   MaterialPipeline transparentPipeline;
+  // read the material from the bindless table instead of set 1
+  MaterialPipeline bindlessOpaquePipeline;
+  MaterialPipeline bindlessTransparentPipeline;
 
   VkDescriptorSetLayout materialLayout;
+  BindlessResources *bindless;
 
   struct MaterialConstants {
     glm::vec4 colorFactors;
@@ -75,6 +208,9 @@ struct GLTFMetallic_Roughness {
     VkSampler metalRoughSampler;
     VkBuffer dataBuffer;
     uint32_t dataBufferOffset;
+    // what dataBuffer holds, kept for the bindless material table
+    glm::vec4 colorFactors;
+    glm::vec4 metalRoughFactors;
   };
 
   DescriptorWriter writer;
@@ -86,6 +222,19 @@ struct GLTFMetallic_Roughness {
   write_material(VkDevice device, MaterialPass pass,
                  const MaterialResources &resources,
                  DescriptorAllocatorGrowable &descriptorAllocator);
+  VkDescriptorSet
+  write_material_set(VkDevice device, const MaterialResources &resources,
+                     DescriptorAllocatorGrowable &descriptorAllocator);
+  // writes resources into a set no pending frame uses
+  void update_material_set(VkDevice device, VkDescriptorSet set,
+                           const MaterialResources &resources);
+  // points the material's bindless entry at new resources. The old texture
+  // slots are kept until frameNumber is done
+  void update_bindless(const MaterialInstance &material,
+                       const MaterialResources &resources, int frameNumber);
+
+private:
+  GPUMaterialData acquire_bindless(const MaterialResources &resources);
 };
 //< gltfmat
 
@@ -96,13 +245,31 @@ struct RenderObject {
   VkBuffer indexBuffer;
 
   MaterialInstance *material;
+  Bounds bounds;
 
   glm::mat4 transform;
   VkDeviceAddress vertexBufferAddress;
+  VkDeviceAddress positionBufferAddress;
 };
 
 struct DrawContext {
   std::vector<RenderObject> OpaqueSurfaces;
+  // blended over the opaque surfaces in their own pass after all of them
+  std::vector<RenderObject> TransparentSurfaces;
+};
+
+// consecutive sorted draws of the same surface and material, recorded as one
+// instanced draw. object is the first RenderObject of the run
+struct DrawBatch {
+  uint32_t object;
+  uint32_t firstInstance;
+  uint32_t instanceCount;
+};
+
+// consecutive batches that bind the same state, one indirect call
+struct DrawGroup {
+  uint32_t first;
+  uint32_t count;
 };
 //< renderobject
 //> meshnode
@@ -114,6 +281,21 @@ struct MeshNode : public Node {
 };
 //< meshnode
 
+// material whose textures are streamed, rewritten whenever one of them is
+// reallocated at a new residency. Frames in flight may still read the set in
+// use, so a change moves the material on to the next set of the ring. At
+// most one change happens per frame, which makes the set being written one
+// that was last used at least FRAME_OVERLAP frames ago
+struct StreamedMaterial {
+  MaterialInstance *instance;
+  MaterialPass pass;
+  GLTFMetallic_Roughness::MaterialResources resources;
+  uint32_t colorTexture;
+  uint32_t metalRoughTexture;
+  VkDescriptorSet sets[FRAME_OVERLAP];
+  uint32_t currentSet;
+};
+
 class VulkanEngine {
 public:
   bool _isInitialized{false};
@@ -130,19 +312,91 @@ public:
 
   FrameData _frames[FRAME_OVERLAP];
 
+  uint32_t get_current_frame_index() const {
+    return _frameNumber % _framesInFlight;
+  }
   FrameData &get_current_frame() {
-    return _frames[_frameNumber % FRAME_OVERLAP];
+    return _frames[get_current_frame_index()];
   };
 
   VkQueue _graphicsQueue;
   uint32_t _graphicsQueueFamily;
 
   VkSurfaceKHR _surface;
-  VkSwapchainKHR _swapchain;
+  VkSwapchainKHR _swapchain{VK_NULL_HANDLE};
   VkFormat _swapchainImageFormat;
   VkExtent2D _swapchainExtent;
   VkExtent2D _drawExtent;
   float renderScale = 1.f;
+  // extra cubes drawn by update_scene, to stress the draw path
+  int stressCubes = 0;
+  // merge draws of the same surface into instanced draws
+  bool useInstancing = true;
+  // record the geometry pass as multi draw indirect calls
+  bool useIndirectDraws = false;
+  // frustum cull in a compute pass that writes the indirect commands
+  bool useGpuCulling = false;
+  // with gpu culling, also cull against a depth pyramid in two phases
+  bool useOcclusionCulling = true;
+  // frustum cull on the cpu before draws enter the draw list. Skipped with
+  // gpu culling, which needs the full list to keep objects apart between
+  // frames
+  bool useCpuCulling = true;
+  // chunks the geometry pass is split into, each recorded into a secondary
+  // command buffer on the job system. 1 records into the frame's primary
+  int recordThreads = 1;
+  // lay down depth with a position only pass first, so the material shaders
+  // run once per pixel instead of once per overlapping fragment
+  bool useDepthPrepass = false;
+  // draw with the bindless material pipelines. Every draw binds the same
+  // material set and indexes textures and constants by material index
+  bool useBindless = false;
+  // push the per frame sets with VK_KHR_push_descriptor instead of
+  // allocating them from the frame's pools. Read once in init, the pipeline
+  // layouts depend on it, and ignored when the device lacks the extension
+  bool usePushDescriptors = true;
+  // render without a window, surface or swapchain into the draw image only,
+  // for headlessFrames frames. Read once in init
+  bool headless = false;
+  int headlessFrames = 100;
+  // where run_headless writes its results as json, nothing when empty
+  std::string headlessReport;
+  // count work per pass in the background and geometry zones
+  bool usePipelineStatistics = false;
+  // where a cpu trace of cpuTraceFrames frames is written, headless the
+  // whole run is traced when headlessCpuTrace is set
+  std::string cpuTracePath = "cpu_trace.json";
+  int cpuTraceFrames = 120;
+  bool headlessCpuTrace = false;
+  // where captureFrames frames of scene state are captured to
+  std::string capturePath = "frames.capture";
+  int captureFrames = 60;
+  // headless, draw the frames captured in replayPath replayLoops times over
+  // instead of building the scene. Read once in init
+  std::string replayPath;
+  int replayLoops = 10;
+  // KTX2 textures of loaded gltf materials upload only their mip tail and
+  // stream finer levels, or all levels at load when off. Read at load
+  bool streamTextures = true;
+  // gltf files loaded next to the default meshes
+  std::vector<std::string> meshFiles;
+  // present mode, frames in flight and frame rate cap. Changes are picked up
+  // before the next frame, the present mode through a swapchain rebuild, and
+  // unsupported present modes fall back to what is in use
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  int framesInFlight = 2;
+  // frames per second, 0 for no limit
+  float frameLimit = 0.f;
+  // let dynamicResolution drive renderScale from the measured gpu time
+  bool useDynamicResolution = false;
+  DynamicResolution dynamicResolution;
+
+  Camera mainCamera;
+
+  EngineStats stats{};
+  DrawBenchmark drawBenchmark;
+  RecordBenchmark recordBenchmark;
+  std::optional<cpucull::BenchmarkResult> cullBenchmark;
   DescriptorAllocatorGrowable globalDescriptorAllocator;
 
   VkPipeline _gradientPipeline;
@@ -152,11 +406,15 @@ public:
   std::vector<VkImage> _swapchainImages;
   std::vector<VkImageView> _swapchainImageViews;
 
-  VkDescriptorSet _drawImageDescriptors;
   VkDescriptorSetLayout _drawImageDescriptorLayout;
+  // bumped whenever the render targets are reallocated, so every frame slot
+  // rewrites its draw image set on its next use
+  uint32_t _drawImageVersion{1};
   VkDescriptorSetLayout _singleImageDescriptorLayout;
 
   DeletionQueue _mainDeletionQueue;
+  // per-frame resources, retired once the frame that used them has finished
+  DeferredDeletionQueue _frameDeletionQueue;
 
   VmaAllocator _allocator; // vma lib allocator
 
@@ -166,6 +424,9 @@ public:
   VkPipelineLayout _meshPipelineLayout;
   VkPipeline _meshPipeline;
 
+  VkPipelineLayout _depthPrepassPipelineLayout;
+  VkPipeline _depthPrepassPipeline;
+
   GPUMeshBuffers rectangle;
   std::vector<std::shared_ptr<MeshAsset>> testMeshes;
   // immediate submit structures
@@ -187,8 +448,82 @@ public:
 
   GLTFMetallic_Roughness metalRoughMaterial;
 
+  TextureStreamer _textureStreamer;
+  BindlessResources _bindless;
+  std::vector<StreamedMaterial> _streamedMaterials;
+  std::unordered_map<const MaterialInstance *, uint32_t>
+      _streamedMaterialLookup;
+
+  // passes of a frame in recording order, render targets are declared with
+  // the range of passes that touch them
+  enum FramePass : uint32_t {
+    PASS_BACKGROUND,
+    PASS_GEOMETRY,
+    PASS_DEPTH_PYRAMID,
+    PASS_GEOMETRY_LATE,
+    PASS_TRANSPARENT,
+    PASS_PRESENT_COPY,
+  };
+
+  // dispatches of cull.comp. Occlusion culling draws what was visible last
+  // frame in the early phase, builds the depth pyramid from that, and the
+  // late phase draws whatever the pyramid doesnt hide and wasnt drawn yet
+  enum CullPhase : uint32_t {
+    CULL_SINGLE,
+    CULL_EARLY,
+    CULL_LATE,
+  };
+
+  RenderTargetPool _renderTargets;
+  uint32_t _drawTarget;
+  uint32_t _depthTarget;
+  uint32_t _depthPyramidTarget;
+
+  JobSystem _jobs;
+  CommandRecorder _recorder;
+
+  // draw order for the frame, rebuilt by sort_draws()
+  std::vector<DrawSortEntry> _drawOrder;
+  std::vector<DrawSortEntry> _drawSortScratch;
+  // transparent surfaces back to front. Their instances follow the opaque
+  // ones in the instance buffer
+  std::vector<DrawSortEntry> _transparentOrder;
+  SortKeyIds _pipelineKeyIds;
+  SortKeyIds _materialKeyIds;
+  SortKeyIds _indexBufferKeyIds;
+  SortKeyIds _surfaceKeyIds;
+  std::vector<DrawBatch> _drawBatches;
+  cpucull::Bounds _cullBounds;
+  std::vector<uint8_t> _cullMasks;
+  std::vector<DrawGroup> _drawGroups;
+  // secondaries of the pass being recorded, in execution order
+  std::vector<VkCommandBuffer> _secondaryBuffers;
+
+  VkPipeline _cullPipeline;
+  VkPipelineLayout _cullPipelineLayout;
+  VkDescriptorSetLayout _cullDescriptorLayout;
+
+  VkPipeline _depthReducePipeline;
+  VkPipelineLayout _depthReducePipelineLayout;
+  VkDescriptorSetLayout _depthReduceDescriptorLayout;
+  // linear filtering with a min reduction, so one sample returns the
+  // farthest depth of a 2x2 footprint
+  VkSampler _depthReduceSampler;
+
+  // one view per pyramid level for the reduction to write through
+  std::vector<VkImageView> _depthPyramidMips;
+  VkExtent2D _depthPyramidExtent;
+
+  // per object visibility of the last frame, indexed by RenderObject. Shared
+  // by all frames since every frame reads what the previous one wrote
+  AllocatedBuffer _visibilityBuffer{};
+  uint32_t _visibilityCount{0};
+  bool _visibilityReset{false};
+
+  // copies of the pool images for the current frame
   AllocatedImage _drawImage;
   AllocatedImage _depthImage;
+  AllocatedImage _depthPyramid;
 
   std::unordered_map<std::string, std::shared_ptr<Node>> loadedNodes;
 
@@ -219,9 +554,15 @@ public:
   void draw_imgui(VkCommandBuffer cmd, VkImageView targetImageView);
 
   void update_scene();
+  // fills mainDrawContext and sceneData from the loaded nodes and the camera
+  void build_scene();
+  // fills them from the next captured frame instead
+  void replay_scene();
 
   // run main loop
   void run();
+  // draws headlessFrames frames and prints their average timings
+  void run_headless();
 
   void immediate_submit(std::function<void(VkCommandBuffer cmd)> &&function);
 
@@ -234,28 +575,143 @@ public:
                               VkImageUsageFlags usage, bool mipmapped = false);
   AllocatedImage create_image(void *data, VkExtent3D size, VkFormat format,
                               VkImageUsageFlags usage, bool mipmapped = false);
+  // uploads the levels of the texture from firstMip on as stored, firstMip
+  // becomes level 0 of the image. The format must be sampleable on this
+  // device
+  AllocatedImage create_image(const TextureData &texture,
+                              VkImageUsageFlags usage, uint32_t firstMip = 0);
+
+  // loads a KTX2 file, decoding it on the cpu when the device cant sample
+  // its compressed format
+  std::optional<AllocatedImage>
+  load_texture(std::filesystem::path filePath,
+               VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT);
+
+  AllocatedImage allocate_image(VkExtent3D size, VkFormat format,
+                                VkImageUsageFlags usage, uint32_t mipLevels);
+
+  // streamed textures only upload their mip tail here, finer levels follow
+  // once something on screen is big enough to need them
+  std::optional<uint32_t> load_streamed_texture(std::filesystem::path filePath);
+  // writes the material into instance and keeps it pointing at the current
+  // images of the streamed textures. Either texture can be INVALID_TEXTURE to
+  // keep the image from resources
+  void register_streamed_material(
+      MaterialInstance *instance, MaterialPass pass,
+      const GLTFMetallic_Roughness::MaterialResources &resources,
+      uint32_t colorTexture, uint32_t metalRoughTexture);
+
+  // between these calls create_image(data) only queues the upload, and all
+  // queued copies and mip chains are recorded into one submit at the end.
+  // Batches nest, the outermost end submits
+  void begin_image_uploads();
+  void end_image_uploads();
 
   void destroy_buffer(const AllocatedBuffer &buffer);
+  void destroy_image(const AllocatedImage &image);
 
   bool resize_requested{false};
   bool freeze_rendering{false};
 
 private:
+  struct PendingImageUpload {
+    AllocatedBuffer staging;
+    AllocatedImage image;
+    bool mipmapped;
+    std::vector<VkBufferImageCopy> copies;
+  };
+  std::vector<PendingImageUpload> _pendingImageUploads;
+  uint32_t _imageUploadBatches{0};
+
+  bool _textureCompressionBC{false};
+  bool _textureCompressionASTC{false};
+  bool _multiDrawIndirect{false};
+  // gpu culling needs it, it stays off without
+  bool _drawIndirectCount{false};
+  // min reduction samplers and separate depth layouts for occlusion culling
+  bool _occlusionCulling{false};
+  // the descriptor indexing features the bindless material set needs
+  bool _bindlessMaterials{false};
+  bool _pipelineStatistics{false};
+  // usePushDescriptors on a device that has them
+  bool _pushDescriptors{false};
+  // timestamps on the graphics queue, and nanoseconds per tick
+  bool _gpuTimestamps{false};
+  float _timestampPeriod{0.f};
+  GpuProfiler _gpuProfiler;
+  // frames the running cpu trace still covers
+  int _cpuTraceFramesLeft{0};
+  // frames the running capture still takes, or the frames being replayed
+  FrameCapture _frameCapture;
+  int _captureFramesLeft{0};
+  bool _replaying{false};
+  uint32_t _replayFrame{0};
+  // reads the gpu clock from the cpu, with VK_EXT_calibrated_timestamps
+  PFN_vkGetCalibratedTimestampsEXT _getCalibratedTimestamps{nullptr};
+
+  // what the swapchain and frame slots currently use
+  VkPresentModeKHR _presentMode{VK_PRESENT_MODE_FIFO_KHR};
+  std::vector<VkPresentModeKHR> _supportedPresentModes;
+  int _framesInFlight{2};
+  std::chrono::steady_clock::time_point _inputTime;
+  std::chrono::steady_clock::time_point _nextFrameTime;
+
+  std::optional<TextureData> load_texture_data(std::filesystem::path filePath);
+  void request_texture_footprints();
+  void frustum_cull_objects();
+  void sort_draws();
+  VkDeviceAddress build_draw_batches();
+  void update_draw_benchmark();
+  void update_record_benchmark();
+
+  using GeometryRecordFn =
+      std::function<void(CommandRecorder &rec, uint32_t begin, uint32_t end)>;
+  // one rendering pass over itemCount items, split into secondaries over
+  // recordThreads chunks when there are enough of them
+  void record_geometry(VkCommandBuffer cmd, const VkRenderingInfo &renderInfo,
+                       uint32_t itemCount, const GeometryRecordFn &record);
+  void reserve_frame_buffer(
+      AllocatedBuffer &buffer, size_t bytes, VkBufferUsageFlags usage,
+      VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU);
+  VkDeviceAddress get_buffer_address(const AllocatedBuffer &buffer);
+  void write_cull_objects();
+  void cull_draws(VkCommandBuffer cmd, CullPhase phase);
+  void build_depth_pyramid(VkCommandBuffer cmd);
+  void read_cull_stats();
+  void read_gpu_time();
+  void apply_present_settings();
+  void limit_frame_rate();
+  // starts a requested cpu trace at the end of a frame, and writes it at
+  // the end of its last frame
+  void update_cpu_trace();
+  void refresh_streamed_materials();
+
+  VkBufferImageCopy level_copy_region(VkDeviceSize bufferOffset,
+                                      uint32_t mipLevel, VkExtent3D extent);
+  void queue_image_upload(PendingImageUpload &&upload);
+  void flush_image_uploads();
+  bool supports_linear_blit(VkFormat format);
+  bool supports_sampled_format(VkFormat format);
+
   void init_vulkan();
 
   void init_swapchain();
   void create_swapchain(uint32_t width, uint32_t height);
   void destroy_swapchain();
   void resize_swapchain();
+  bool declare_render_targets();
 
   void init_commands();
 
   void init_background_pipelines();
+  void init_cull_pipeline();
+  void init_depth_reduce_pipeline();
 
   void init_pipelines();
 
   void init_triangle_pipeline();
   void init_mesh_pipeline();
+  void init_depth_prepass_pipeline();
 
   void init_descriptors();
 
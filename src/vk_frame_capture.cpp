@@ -0,0 +1,297 @@
+#include "vk_frame_capture.h"
+
+#include "vk_engine.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+// the file is a header, the surface table, then the frames one after the
+// other, every count right before what it counts
+constexpr uint32_t CAPTURE_MAGIC = 0x43464b56; // "VKFC"
+constexpr uint32_t CAPTURE_VERSION = 1;
+
+struct CaptureHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  float renderScale;
+  uint32_t surfaceCount;
+  uint32_t frameCount;
+};
+
+// the fixed size part of a frame, the two object lists follow it
+struct FrameHeader {
+  uint32_t backgroundEffect;
+  uint32_t opaqueCount;
+  uint32_t transparentCount;
+  ComputePushConstants effectData;
+  GPUSceneData sceneData;
+};
+
+template <typename T> void write_value(std::ofstream &file, const T &value) {
+  file.write((const char *)&value, sizeof(T));
+}
+
+template <typename T> bool read_value(std::ifstream &file, T &value) {
+  return (bool)file.read((char *)&value, sizeof(T));
+}
+
+// what is left of the file past the read position. Counts are checked
+// against it before anything is sized by them, a corrupt count would
+// otherwise allocate whatever it says
+uint64_t remaining_bytes(std::ifstream &file) {
+  std::streampos position = file.tellg();
+  file.seekg(0, std::ios::end);
+  std::streampos end = file.tellg();
+  file.seekg(position);
+  if (position < 0 || end < position) {
+    return 0;
+  }
+  return (uint64_t)(end - position);
+}
+
+void write_objects(std::ofstream &file,
+                   const std::vector<CapturedObject> &objects) {
+  file.write((const char *)objects.data(),
+             objects.size() * sizeof(CapturedObject));
+}
+
+bool read_objects(std::ifstream &file, uint32_t count, uint32_t surfaceCount,
+                  std::vector<CapturedObject> &objects) {
+  if ((uint64_t)count * sizeof(CapturedObject) > remaining_bytes(file)) {
+    return false;
+  }
+  objects.resize(count);
+  if (!file.read((char *)objects.data(), count * sizeof(CapturedObject))) {
+    return false;
+  }
+  for (const CapturedObject &object : objects) {
+    if (object.surface >= surfaceCount) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+void FrameCapture::begin(
+    VkExtent2D extent, float renderScale,
+    const std::vector<std::shared_ptr<MeshAsset>> &meshes) {
+  _extent = extent;
+  _renderScale = renderScale;
+  _frames.clear();
+  _surfaces.clear();
+  _surfaceLookup.clear();
+  _skipped = 0;
+
+  for (const std::shared_ptr<MeshAsset> &mesh : meshes) {
+    for (uint32_t i = 0; i < mesh->surfaces.size(); i++) {
+      SurfaceKey key{mesh->meshBuffers.indexBuffer.buffer,
+                     mesh->surfaces[i].startIndex};
+      _surfaceLookup[key] = (uint32_t)_surfaces.size();
+      _surfaces.push_back({mesh->name, i});
+    }
+  }
+}
+
+void FrameCapture::capture(const DrawContext &context,
+                           const GPUSceneData &sceneData,
+                           uint32_t backgroundEffect,
+                           const ComputePushConstants &effectData) {
+  CapturedFrame &frame = _frames.emplace_back();
+  frame.backgroundEffect = backgroundEffect;
+  frame.effectData = effectData;
+  frame.sceneData = sceneData;
+  capture_objects(context.OpaqueSurfaces, frame.opaque);
+  capture_objects(context.TransparentSurfaces, frame.transparent);
+}
+
+void FrameCapture::capture_objects(const std::vector<RenderObject> &objects,
+                                   std::vector<CapturedObject> &captured) {
+  captured.reserve(objects.size());
+  for (const RenderObject &object : objects) {
+    auto it = _surfaceLookup.find({object.indexBuffer, object.firstIndex});
+    if (it == _surfaceLookup.end()) {
+      _skipped++;
+      continue;
+    }
+
+    CapturedObject &out = captured.emplace_back();
+    out.surface = it->second;
+    for (int c = 0; c < 4; c++) {
+      for (int r = 0; r < 3; r++) {
+        out.transform[c * 3 + r] = object.transform[c][r];
+      }
+    }
+  }
+}
+
+bool FrameCapture::write(const std::string &path) const {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    fmt::println("could not write {}", path);
+    return false;
+  }
+
+  CaptureHeader header{.magic = CAPTURE_MAGIC,
+                       .version = CAPTURE_VERSION,
+                       .width = _extent.width,
+                       .height = _extent.height,
+                       .renderScale = _renderScale,
+                       .surfaceCount = (uint32_t)_surfaces.size(),
+                       .frameCount = (uint32_t)_frames.size()};
+  write_value(file, header);
+
+  for (const SurfaceName &surface : _surfaces) {
+    write_value(file, (uint32_t)surface.mesh.size());
+    file.write(surface.mesh.data(), surface.mesh.size());
+    write_value(file, surface.surface);
+  }
+
+  for (const CapturedFrame &frame : _frames) {
+    FrameHeader frameHeader{
+        .backgroundEffect = frame.backgroundEffect,
+        .opaqueCount = (uint32_t)frame.opaque.size(),
+        .transparentCount = (uint32_t)frame.transparent.size(),
+        .effectData = frame.effectData,
+        .sceneData = frame.sceneData};
+    write_value(file, frameHeader);
+    write_objects(file, frame.opaque);
+    write_objects(file, frame.transparent);
+  }
+
+  if (!file) {
+    fmt::println("could not write {}", path);
+    return false;
+  }
+  fmt::println("captured {} frames to {}", _frames.size(), path);
+  if (_skipped > 0) {
+    fmt::println("{} draws not made from a mesh surface were left out",
+                 _skipped);
+  }
+  return true;
+}
+
+bool FrameCapture::read(const std::string &path) {
+  _frames.clear();
+  _surfaces.clear();
+  _resolved.clear();
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    fmt::println("could not open capture {}", path);
+    return false;
+  }
+
+  CaptureHeader header;
+  if (!read_value(file, header) || header.magic != CAPTURE_MAGIC ||
+      header.version != CAPTURE_VERSION) {
+    fmt::println("{} is not a frame capture", path);
+    return false;
+  }
+  _extent = {header.width, header.height};
+  _renderScale = header.renderScale;
+
+  // every surface takes at least its name length and index
+  if ((uint64_t)header.surfaceCount * 2 * sizeof(uint32_t) >
+      remaining_bytes(file)) {
+    fmt::println("capture {} is truncated or corrupt", path);
+    return false;
+  }
+
+  _surfaces.resize(header.surfaceCount);
+  for (SurfaceName &surface : _surfaces) {
+    // mesh names are short, a long one means the file is not what it says
+    uint32_t length = 0;
+    if (!read_value(file, length) || length > 1024 ||
+        length > remaining_bytes(file)) {
+      file.setstate(std::ios::failbit);
+      break;
+    }
+    surface.mesh.resize(length);
+    file.read(surface.mesh.data(), length);
+    read_value(file, surface.surface);
+  }
+  if (!file) {
+    fmt::println("capture {} is truncated or corrupt", path);
+    _surfaces.clear();
+    return false;
+  }
+
+  // and every frame at least its header
+  if ((uint64_t)header.frameCount * sizeof(FrameHeader) >
+      remaining_bytes(file)) {
+    fmt::println("capture {} is truncated or corrupt", path);
+    _surfaces.clear();
+    return false;
+  }
+  _frames.resize(header.frameCount);
+  for (CapturedFrame &frame : _frames) {
+    FrameHeader frameHeader;
+    if (!read_value(file, frameHeader) ||
+        !read_objects(file, frameHeader.opaqueCount, header.surfaceCount,
+                      frame.opaque) ||
+        !read_objects(file, frameHeader.transparentCount,
+                      header.surfaceCount, frame.transparent)) {
+      fmt::println("capture {} is truncated or corrupt", path);
+      _frames.clear();
+      return false;
+    }
+    frame.backgroundEffect = frameHeader.backgroundEffect;
+    frame.effectData = frameHeader.effectData;
+    frame.sceneData = frameHeader.sceneData;
+  }
+  return true;
+}
+
+bool FrameCapture::resolve(
+    const std::vector<std::shared_ptr<MeshAsset>> &meshes) {
+  _resolved.clear();
+  for (const SurfaceName &name : _surfaces) {
+    auto it = std::find_if(meshes.begin(), meshes.end(),
+                           [&](const std::shared_ptr<MeshAsset> &mesh) {
+                             return mesh->name == name.mesh;
+                           });
+    if (it == meshes.end() || name.surface >= (*it)->surfaces.size()) {
+      fmt::println("capture draws surface {} of {}, which is not loaded",
+                   name.surface, name.mesh);
+      return false;
+    }
+
+    // the same as MeshNode::Draw makes it
+    const MeshAsset &mesh = **it;
+    const GeoSurface &surface = mesh.surfaces[name.surface];
+    RenderObject &object = _resolved.emplace_back();
+    object.indexCount = surface.count;
+    object.firstIndex = surface.startIndex;
+    object.indexBuffer = mesh.meshBuffers.indexBuffer.buffer;
+    object.material = &surface.material->data;
+    object.bounds = surface.bounds;
+    object.transform = glm::mat4{1.f};
+    object.vertexBufferAddress = mesh.meshBuffers.vertexBufferAddress;
+    object.positionBufferAddress = mesh.meshBuffers.positionBufferAddress;
+  }
+  return true;
+}
+
+void FrameCapture::replay(const CapturedFrame &frame,
+                          DrawContext &context) const {
+  replay_objects(frame.opaque, context.OpaqueSurfaces);
+  replay_objects(frame.transparent, context.TransparentSurfaces);
+}
+
+void FrameCapture::replay_objects(const std::vector<CapturedObject> &captured,
+                                  std::vector<RenderObject> &objects) const {
+  objects.clear();
+  objects.reserve(captured.size());
+  for (const CapturedObject &in : captured) {
+    RenderObject &object = objects.emplace_back(_resolved[in.surface]);
+    for (int c = 0; c < 4; c++) {
+      for (int r = 0; r < 3; r++) {
+        object.transform[c][r] = in.transform[c * 3 + r];
+      }
+    }
+  }
+}
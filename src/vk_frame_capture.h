@@ -0,0 +1,88 @@
+#pragma once
+#include "vk_types.h"
+
+#include <unordered_map>
+
+struct DrawContext;
+struct MeshAsset;
+struct RenderObject;
+
+//> frame_capture
+// Scene state of consecutive frames, what update_scene hands to the
+// renderer: the draws, the scene data and the background effect. Draws
+// refer to mesh surfaces by mesh name and surface index, so a capture
+// replays in any later run that loaded the same meshes, with whatever
+// renderer that run has. Transforms are stored as affine 4x3 matrices.
+struct CapturedObject {
+  uint32_t surface;
+  float transform[12];
+};
+
+struct CapturedFrame {
+  uint32_t backgroundEffect;
+  ComputePushConstants effectData;
+  GPUSceneData sceneData;
+  std::vector<CapturedObject> opaque;
+  std::vector<CapturedObject> transparent;
+};
+
+class FrameCapture {
+public:
+  // drops any frames held and starts capturing at the given size, draws
+  // are matched against the surfaces of meshes
+  void begin(VkExtent2D extent, float renderScale,
+             const std::vector<std::shared_ptr<MeshAsset>> &meshes);
+  void capture(const DrawContext &context, const GPUSceneData &sceneData,
+               uint32_t backgroundEffect,
+               const ComputePushConstants &effectData);
+  bool write(const std::string &path) const;
+
+  // false when the file is missing or malformed
+  bool read(const std::string &path);
+  // finds the surfaces the frames draw in meshes, false if one is missing
+  bool resolve(const std::vector<std::shared_ptr<MeshAsset>> &meshes);
+  // replaces the draws in context with the frame's, after resolve
+  void replay(const CapturedFrame &frame, DrawContext &context) const;
+
+  uint32_t frame_count() const { return (uint32_t)_frames.size(); }
+  const CapturedFrame &frame(uint32_t index) const { return _frames[index]; }
+  VkExtent2D extent() const { return _extent; }
+  float render_scale() const { return _renderScale; }
+
+private:
+  struct SurfaceName {
+    std::string mesh;
+    uint32_t surface;
+  };
+  // what a RenderObject made from a surface is known by while capturing
+  struct SurfaceKey {
+    VkBuffer indexBuffer;
+    uint32_t firstIndex;
+
+    bool operator==(const SurfaceKey &) const = default;
+  };
+  struct SurfaceKeyHash {
+    size_t operator()(const SurfaceKey &key) const {
+      return std::hash<uint64_t>()((uint64_t)key.indexBuffer) ^
+             (std::hash<uint32_t>()(key.firstIndex) << 1);
+    }
+  };
+
+  void capture_objects(const std::vector<RenderObject> &objects,
+                       std::vector<CapturedObject> &captured);
+  void replay_objects(const std::vector<CapturedObject> &captured,
+                      std::vector<RenderObject> &objects) const;
+
+  VkExtent2D _extent{};
+  float _renderScale{1.f};
+  std::vector<SurfaceName> _surfaces;
+  std::vector<CapturedFrame> _frames;
+
+  std::unordered_map<SurfaceKey, uint32_t, SurfaceKeyHash> _surfaceLookup;
+  // draws that were not made from a known surface and got left out
+  uint32_t _skipped{0};
+
+  // one per surface, every field but the transform filled in by resolve
+  std::vector<RenderObject> _resolved;
+};
+//< frame_capture
@@ -0,0 +1,200 @@
+#include "vk_gpu_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+float GpuProfiler::Zone::min() const {
+  if (samples == 0) {
+    return 0.f;
+  }
+  return *std::min_element(history, history + samples);
+}
+
+float GpuProfiler::Zone::max() const {
+  if (samples == 0) {
+    return 0.f;
+  }
+  return *std::max_element(history, history + samples);
+}
+
+float GpuProfiler::Zone::average() const {
+  if (samples == 0) {
+    return 0.f;
+  }
+  float sum = 0.f;
+  for (uint32_t i = 0; i < samples; i++) {
+    sum += history[i];
+  }
+  return sum / samples;
+}
+
+void GpuProfiler::init(VkDevice device, uint32_t slots, bool supported,
+                       float timestampPeriod, bool statisticsSupported) {
+  _enabled = supported;
+  _statistics = supported && statisticsSupported;
+  _timestampPeriod = timestampPeriod;
+  _slots.resize(slots);
+  if (!_enabled) {
+    return;
+  }
+
+  VkQueryPoolCreateInfo queryInfo{
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = 2 * MAX_ZONES};
+  VkQueryPoolCreateInfo statisticsInfo{
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+      .queryCount = MAX_ZONES,
+      .pipelineStatistics = STATISTICS};
+  for (Slot &slot : _slots) {
+    VK_CHECK(vkCreateQueryPool(device, &queryInfo, nullptr, &slot.pool));
+    if (_statistics) {
+      VK_CHECK(vkCreateQueryPool(device, &statisticsInfo, nullptr,
+                                 &slot.statisticsPool));
+    }
+    slot.recorded.reserve(MAX_ZONES);
+  }
+}
+
+void GpuProfiler::destroy(VkDevice device) {
+  for (Slot &slot : _slots) {
+    if (slot.pool != VK_NULL_HANDLE) {
+      vkDestroyQueryPool(device, slot.pool, nullptr);
+    }
+    if (slot.statisticsPool != VK_NULL_HANDLE) {
+      vkDestroyQueryPool(device, slot.statisticsPool, nullptr);
+    }
+  }
+  _slots.clear();
+  _zones.clear();
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer cmd, uint32_t slot) {
+  _current = slot;
+  if (!_enabled) {
+    return;
+  }
+  Slot &frame = _slots[slot];
+  vkCmdResetQueryPool(cmd, frame.pool, 0, 2 * MAX_ZONES);
+  if (_statistics) {
+    vkCmdResetQueryPool(cmd, frame.statisticsPool, 0, MAX_ZONES);
+  }
+  frame.recorded.clear();
+  frame.statisticsUsed = 0;
+  frame.written = true;
+}
+
+uint32_t GpuProfiler::begin_zone(VkCommandBuffer cmd, const char *name,
+                                 bool statistics) {
+  if (!_enabled) {
+    return UINT32_MAX;
+  }
+  Slot &frame = _slots[_current];
+  if (frame.recorded.size() >= MAX_ZONES) {
+    return UINT32_MAX;
+  }
+
+  uint32_t query = 2 * (uint32_t)frame.recorded.size();
+  uint32_t statisticsQuery = UINT32_MAX;
+  if (statistics && _statistics) {
+    statisticsQuery = frame.statisticsUsed++;
+  }
+  frame.recorded.push_back({zone_index(name), query, statisticsQuery});
+
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, frame.pool,
+                       query);
+  if (statisticsQuery != UINT32_MAX) {
+    vkCmdBeginQuery(cmd, frame.statisticsPool, statisticsQuery, 0);
+  }
+  return (uint32_t)frame.recorded.size() - 1;
+}
+
+void GpuProfiler::end_zone(VkCommandBuffer cmd, uint32_t zone) {
+  if (zone == UINT32_MAX) {
+    return;
+  }
+  Slot &frame = _slots[_current];
+  const RecordedZone &recorded = frame.recorded[zone];
+  if (recorded.statisticsQuery != UINT32_MAX) {
+    vkCmdEndQuery(cmd, frame.statisticsPool, recorded.statisticsQuery);
+  }
+  vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, frame.pool,
+                       recorded.query + 1);
+}
+
+bool GpuProfiler::resolve(VkDevice device, uint32_t slot) {
+  if (!_enabled) {
+    return false;
+  }
+  Slot &frame = _slots[slot];
+  if (!frame.written || frame.recorded.empty()) {
+    return false;
+  }
+  frame.written = false;
+
+  uint64_t ticks[2 * MAX_ZONES];
+  uint32_t queryCount = 2 * (uint32_t)frame.recorded.size();
+  VkResult result = vkGetQueryPoolResults(
+      device, frame.pool, 0, queryCount, queryCount * sizeof(uint64_t), ticks,
+      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+
+  PipelineStatistics statistics[MAX_ZONES];
+  if (frame.statisticsUsed > 0) {
+    result = vkGetQueryPoolResults(
+        device, frame.statisticsPool, 0, frame.statisticsUsed,
+        frame.statisticsUsed * sizeof(PipelineStatistics), statistics,
+        sizeof(PipelineStatistics), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+      return false;
+    }
+  }
+
+  for (const RecordedZone &recorded : frame.recorded) {
+    uint64_t begin = ticks[recorded.query];
+    uint64_t end = ticks[recorded.query + 1];
+
+    Zone &zone = _zones[recorded.zone];
+    zone.last = (end - begin) * _timestampPeriod / 1000000.f;
+    zone.lastEndTicks = end;
+    zone.history[zone.head] = zone.last;
+    zone.head = (zone.head + 1) % HISTORY;
+    zone.samples = std::min(zone.samples + 1, HISTORY);
+
+    zone.hasStatistics = recorded.statisticsQuery != UINT32_MAX;
+    if (zone.hasStatistics) {
+      zone.statistics = statistics[recorded.statisticsQuery];
+    }
+  }
+  return true;
+}
+
+void GpuProfiler::discard() {
+  for (Slot &slot : _slots) {
+    slot.written = false;
+  }
+}
+
+const GpuProfiler::Zone *GpuProfiler::find(const char *name) const {
+  for (const Zone &zone : _zones) {
+    if (strcmp(zone.name, name) == 0) {
+      return zone.samples > 0 ? &zone : nullptr;
+    }
+  }
+  return nullptr;
+}
+
+uint32_t GpuProfiler::zone_index(const char *name) {
+  for (uint32_t i = 0; i < _zones.size(); i++) {
+    if (strcmp(_zones[i].name, name) == 0) {
+      return i;
+    }
+  }
+  Zone zone{};
+  zone.name = name;
+  _zones.push_back(zone);
+  return (uint32_t)_zones.size() - 1;
+}
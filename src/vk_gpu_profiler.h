@@ -0,0 +1,120 @@
+#pragma once
+#include "vk_types.h"
+
+//> gpu_profiler
+// Timestamp pairs around the passes of a frame. Every frame slot has its own
+// query pool, and a slot's results are read once its fence has signaled
+// again, so reading never waits on the gpu and the numbers are as many
+// frames late as there are frames in flight. Zones are told apart by name,
+// each keeps a rolling history of its last HISTORY times. Zones may also
+// count pipeline statistics, those must not overlap each other.
+class GpuProfiler {
+public:
+  static constexpr uint32_t MAX_ZONES = 16;
+  static constexpr uint32_t HISTORY = 128;
+
+  // in the order the queries return them, lowest flag bit first
+  struct PipelineStatistics {
+    uint64_t inputVertices;
+    uint64_t vertexInvocations;
+    uint64_t clippingPrimitives;
+    uint64_t fragmentInvocations;
+    uint64_t computeInvocations;
+  };
+  static constexpr VkQueryPipelineStatisticFlags STATISTICS =
+      VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+  struct Zone {
+    // a string literal, zones with the same name are the same zone
+    const char *name;
+    // milliseconds, history is a ring that starts at head
+    float last;
+    float history[HISTORY];
+    uint32_t head;
+    uint32_t samples;
+    // gpu clock at the end of the zone, in ticks, for lining it up with
+    // other clocks
+    uint64_t lastEndTicks;
+    // of the last frame the zone counted them in
+    PipelineStatistics statistics;
+    bool hasStatistics;
+
+    float min() const;
+    float max() const;
+    float average() const;
+  };
+
+  // without timestamp support every call below does nothing, without
+  // statistics support zones only time
+  void init(VkDevice device, uint32_t slots, bool supported,
+            float timestampPeriod, bool statisticsSupported);
+  void destroy(VkDevice device);
+
+  // resets the slot's queries, recorded before any zone of the frame
+  void begin_frame(VkCommandBuffer cmd, uint32_t slot);
+  // returns the zone to pass to end_zone. Outside of any render pass
+  uint32_t begin_zone(VkCommandBuffer cmd, const char *name,
+                      bool statistics = false);
+  void end_zone(VkCommandBuffer cmd, uint32_t zone);
+
+  // reads what the slot recorded, the frame that used it has to be done.
+  // Returns false when there was nothing new
+  bool resolve(VkDevice device, uint32_t slot);
+  // forgets unread results, for when they no longer belong to any slot
+  void discard();
+
+  bool enabled() const { return _enabled; }
+  // what secondaries executed inside a counting zone have to inherit
+  VkQueryPipelineStatisticFlags statistics_flags() const {
+    return _statistics ? STATISTICS : 0;
+  }
+  const std::vector<Zone> &zones() const { return _zones; }
+  // nullptr until the zone has been resolved once
+  const Zone *find(const char *name) const;
+
+private:
+  struct RecordedZone {
+    uint32_t zone;
+    uint32_t query;
+    // statistics query, UINT32_MAX when the zone only times
+    uint32_t statisticsQuery;
+  };
+  struct Slot {
+    VkQueryPool pool{VK_NULL_HANDLE};
+    VkQueryPool statisticsPool{VK_NULL_HANDLE};
+    std::vector<RecordedZone> recorded;
+    uint32_t statisticsUsed{0};
+    bool written{false};
+  };
+
+  bool _enabled{false};
+  bool _statistics{false};
+  float _timestampPeriod{0.f};
+  std::vector<Slot> _slots;
+  uint32_t _current{0};
+  std::vector<Zone> _zones;
+
+  uint32_t zone_index(const char *name);
+};
+
+// end_zone at the end of the scope
+struct GpuZoneScope {
+  GpuZoneScope(GpuProfiler &profiler, VkCommandBuffer cmd, const char *name,
+               bool statistics = false)
+      : _profiler(profiler), _cmd(cmd),
+        _zone(profiler.begin_zone(cmd, name, statistics)) {}
+  ~GpuZoneScope() { _profiler.end_zone(_cmd, _zone); }
+
+  GpuZoneScope(const GpuZoneScope &) = delete;
+  GpuZoneScope &operator=(const GpuZoneScope &) = delete;
+
+private:
+  GpuProfiler &_profiler;
+  VkCommandBuffer _cmd;
+  uint32_t _zone;
+};
+//< gpu_profiler
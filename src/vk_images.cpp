@@ -1,11 +1,15 @@
 #include "vk_images.h"
 #include "vk_initializers.h"
+
+#include <algorithm>
+#include <cmath>
 void vkutil::transition_image(VkCommandBuffer cmd, VkImage image,
                               VkImageLayout currentLayout,
                               VkImageLayout newLayout) {
 
   VkImageAspectFlags aspectMask =
-      (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
+      (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+       newLayout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL)
           ? VK_IMAGE_ASPECT_DEPTH_BIT
           : VK_IMAGE_ASPECT_COLOR_BIT;
 
@@ -34,6 +38,26 @@ void vkutil::transition_image(VkCommandBuffer cmd, VkImage image,
   vkCmdPipelineBarrier2(cmd, &depInfo);
 }
 
+void vkutil::memory_barrier(VkCommandBuffer cmd,
+                            VkPipelineStageFlags2 srcStage,
+                            VkAccessFlags2 srcAccess,
+                            VkPipelineStageFlags2 dstStage,
+                            VkAccessFlags2 dstAccess) {
+  VkMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                           .pNext = nullptr,
+                           .srcStageMask = srcStage,
+                           .srcAccessMask = srcAccess,
+                           .dstStageMask = dstStage,
+                           .dstAccessMask = dstAccess};
+
+  VkDependencyInfo depInfo{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                           .pNext = nullptr,
+                           .memoryBarrierCount = 1,
+                           .pMemoryBarriers = &barrier};
+
+  vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
 void vkutil::copy_image_to_image(VkCommandBuffer cmd, VkImage source,
                                  VkImage destination, VkExtent2D srcSize,
                                  VkExtent2D dstSize) {
@@ -71,3 +95,184 @@ void vkutil::copy_image_to_image(VkCommandBuffer cmd, VkImage source,
 
   vkCmdBlitImage2(cmd, &blitInfo);
 }
+
+uint32_t vkutil::mip_level_count(VkExtent2D imageSize) {
+  return static_cast<uint32_t>(
+             std::floor(std::log2(std::max(imageSize.width, imageSize.height)))) +
+         1;
+}
+
+//> mipgen
+void vkutil::generate_mipmaps(VkCommandBuffer cmd, VkImage image,
+                              VkExtent2D imageSize) {
+  uint32_t mipLevels = mip_level_count(imageSize);
+
+  for (uint32_t mip = 0; mip < mipLevels; mip++) {
+    VkExtent2D halfSize{std::max(imageSize.width / 2, 1u),
+                        std::max(imageSize.height / 2, 1u)};
+
+    // the level was written by the copy or the previous blit, turn it into
+    // the source of the next blit. Only this level is touched so the rest of
+    // the chain stays writable
+    VkImageMemoryBarrier2 imageBarrier{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .pNext = nullptr,
+        .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .image = image,
+        .subresourceRange =
+            vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT),
+    };
+    imageBarrier.subresourceRange.baseMipLevel = mip;
+    imageBarrier.subresourceRange.levelCount = 1;
+
+    VkDependencyInfo depInfo{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                             .pNext = nullptr};
+    depInfo.imageMemoryBarrierCount = 1;
+    depInfo.pImageMemoryBarriers = &imageBarrier;
+
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+
+    if (mip < mipLevels - 1) {
+      VkImageBlit2 blitRegion{.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
+                              .pNext = nullptr};
+
+      blitRegion.srcOffsets[1].x = imageSize.width;
+      blitRegion.srcOffsets[1].y = imageSize.height;
+      blitRegion.srcOffsets[1].z = 1;
+
+      blitRegion.dstOffsets[1].x = halfSize.width;
+      blitRegion.dstOffsets[1].y = halfSize.height;
+      blitRegion.dstOffsets[1].z = 1;
+
+      blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      blitRegion.srcSubresource.baseArrayLayer = 0;
+      blitRegion.srcSubresource.layerCount = 1;
+      blitRegion.srcSubresource.mipLevel = mip;
+
+      blitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      blitRegion.dstSubresource.baseArrayLayer = 0;
+      blitRegion.dstSubresource.layerCount = 1;
+      blitRegion.dstSubresource.mipLevel = mip + 1;
+
+      VkBlitImageInfo2 blitInfo{.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2,
+                                .pNext = nullptr};
+      blitInfo.dstImage = image;
+      blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      blitInfo.srcImage = image;
+      blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+      blitInfo.filter = VK_FILTER_LINEAR;
+      blitInfo.regionCount = 1;
+      blitInfo.pRegions = &blitRegion;
+
+      vkCmdBlitImage2(cmd, &blitInfo);
+
+      imageSize = halfSize;
+    }
+  }
+
+  // transition all mip levels into the final read_only layout
+  transition_image(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+//< mipgen
+
+//> format_info
+vkutil::FormatBlock vkutil::format_block(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_R8_UNORM:
+  case VK_FORMAT_R8_SRGB:
+    return {1, 1, 1};
+  case VK_FORMAT_R8G8_UNORM:
+  case VK_FORMAT_R8G8_SRGB:
+    return {1, 1, 2};
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+  case VK_FORMAT_R32_SFLOAT:
+  case VK_FORMAT_D32_SFLOAT:
+    return {1, 1, 4};
+  case VK_FORMAT_R16G16B16A16_SFLOAT:
+    return {1, 1, 8};
+  case VK_FORMAT_R32G32B32A32_SFLOAT:
+    return {1, 1, 16};
+
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+  case VK_FORMAT_BC4_SNORM_BLOCK:
+    return {4, 4, 8};
+  case VK_FORMAT_BC2_UNORM_BLOCK:
+  case VK_FORMAT_BC2_SRGB_BLOCK:
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC5_SNORM_BLOCK:
+  case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+  case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return {4, 4, 16};
+
+  // every astc block is 128 bits, only the footprint changes
+  case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+  case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+    return {4, 4, 16};
+  case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:
+  case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:
+    return {5, 5, 16};
+  case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:
+  case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:
+    return {6, 6, 16};
+  case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
+  case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:
+    return {8, 8, 16};
+  case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:
+  case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:
+    return {10, 10, 16};
+  case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:
+  case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:
+    return {12, 12, 16};
+  default:
+    return {0, 0, 0};
+  }
+}
+
+bool vkutil::is_bc_format(VkFormat format) {
+  return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK &&
+         format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+bool vkutil::is_astc_format(VkFormat format) {
+  return format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK &&
+         format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+}
+
+bool vkutil::is_compressed_format(VkFormat format) {
+  return is_bc_format(format) || is_astc_format(format);
+}
+
+size_t vkutil::image_level_size(VkFormat format, VkExtent3D extent) {
+  FormatBlock block = format_block(format);
+  if (block.bytes == 0) {
+    return 0;
+  }
+
+  size_t blocksX = (extent.width + block.width - 1) / block.width;
+  size_t blocksY = (extent.height + block.height - 1) / block.height;
+  return blocksX * blocksY * extent.depth * block.bytes;
+}
+
+VkExtent3D vkutil::mip_level_extent(VkExtent3D extent, uint32_t level) {
+  return VkExtent3D{std::max(extent.width >> level, 1u),
+                    std::max(extent.height >> level, 1u),
+                    std::max(extent.depth >> level, 1u)};
+}
+//< format_info
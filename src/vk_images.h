@@ -1,11 +1,40 @@
 #pragma once
+#include <cstddef>
 #include <vulkan/vulkan.h>
 namespace vkutil {
 
+// texel block of a format, 1x1 for uncompressed formats
+struct FormatBlock {
+  uint32_t width;
+  uint32_t height;
+  uint32_t bytes;
+};
+
+// returns a zero sized block for formats the engine does not know about
+FormatBlock format_block(VkFormat format);
+bool is_compressed_format(VkFormat format);
+bool is_bc_format(VkFormat format);
+bool is_astc_format(VkFormat format);
+
+// tightly packed size of one mip level
+size_t image_level_size(VkFormat format, VkExtent3D extent);
+VkExtent3D mip_level_extent(VkExtent3D extent, uint32_t level);
+
 void transition_image(VkCommandBuffer cmd, VkImage image,
                       VkImageLayout currentLayout, VkImageLayout newLayout);
 
+// global memory dependency, for buffers written and read on the gpu
+void memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage,
+                    VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage,
+                    VkAccessFlags2 dstAccess);
+
 void copy_image_to_image(VkCommandBuffer cmd, VkImage source,
                          VkImage destination, VkExtent2D srcSize,
                          VkExtent2D dstSize);
+
+uint32_t mip_level_count(VkExtent2D imageSize);
+
+// expects every level in TRANSFER_DST_OPTIMAL with level 0 filled, leaves the
+// whole chain in SHADER_READ_ONLY_OPTIMAL
+void generate_mipmaps(VkCommandBuffer cmd, VkImage image, VkExtent2D imageSize);
 }; // namespace vkutil
@@ -0,0 +1,112 @@
+#include "vk_jobs.h"
+
+#include "vk_cpu_profiler.h"
+
+#include <algorithm>
+
+void JobSystem::init(uint32_t workerCount) {
+  if (workerCount == 0) {
+    uint32_t hardware = std::thread::hardware_concurrency();
+    workerCount = hardware > 1 ? hardware - 1 : 0;
+  }
+
+  _quit = false;
+  for (uint32_t i = 0; i < workerCount; i++) {
+    _workers.emplace_back([this]() {
+      cpuprof::set_thread_name("worker");
+      worker_loop();
+    });
+  }
+}
+
+void JobSystem::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _wake.notify_all();
+
+  for (std::thread &worker : _workers) {
+    worker.join();
+  }
+  _workers.clear();
+}
+
+void JobSystem::parallel_for(uint32_t count, uint32_t chunkSize,
+                             const RangeFn &fn) {
+  if (count == 0) {
+    return;
+  }
+  chunkSize = std::max(chunkSize, 1u);
+  uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+  // not worth waking anyone up for
+  if (_workers.empty() || chunkCount == 1) {
+    for (uint32_t begin = 0; begin < count; begin += chunkSize) {
+      fn(begin, std::min(begin + chunkSize, count));
+    }
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    // a worker that woke up late for the last job may still be checking for
+    // chunks, the job fields cant change under it
+    _done.wait(lock, [&]() { return _activeWorkers == 0; });
+
+    _job = &fn;
+    _count = count;
+    _chunkSize = chunkSize;
+    _chunkCount = chunkCount;
+    _nextChunk = 0;
+    _pendingChunks = chunkCount;
+    _generation++;
+  }
+  _wake.notify_all();
+
+  run_chunks();
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [&]() { return _pendingChunks == 0; });
+  _job = nullptr;
+}
+
+void JobSystem::worker_loop() {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [&]() { return _quit || _generation != seen; });
+      if (_quit) {
+        return;
+      }
+      seen = _generation;
+      _activeWorkers++;
+    }
+
+    run_chunks();
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _activeWorkers--;
+    }
+    _done.notify_all();
+  }
+}
+
+void JobSystem::run_chunks() {
+  while (true) {
+    uint32_t chunk = _nextChunk.fetch_add(1);
+    if (chunk >= _chunkCount) {
+      return;
+    }
+
+    uint32_t begin = chunk * _chunkSize;
+    (*_job)(begin, std::min(begin + _chunkSize, _count));
+
+    if (_pendingChunks.fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _done.notify_all();
+    }
+  }
+}
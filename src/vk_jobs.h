@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//> job_system
+// Fixed set of worker threads for splitting per-frame cpu work into chunks.
+// parallel_for blocks until every chunk is done and the calling thread works
+// on chunks too, so with zero workers everything simply runs inline.
+class JobSystem {
+public:
+  using RangeFn = std::function<void(uint32_t begin, uint32_t end)>;
+
+  // workerCount 0 picks one worker per hardware thread, minus the caller
+  void init(uint32_t workerCount = 0);
+  void shutdown();
+
+  // calls fn on [begin, end) ranges of at most chunkSize items covering
+  // [0, count). Only one thread may call this at a time
+  void parallel_for(uint32_t count, uint32_t chunkSize, const RangeFn &fn);
+
+  // workers plus the calling thread
+  uint32_t thread_count() const { return (uint32_t)_workers.size() + 1; }
+
+private:
+  void worker_loop();
+  void run_chunks();
+
+  std::vector<std::thread> _workers;
+
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _done;
+  bool _quit{false};
+  uint64_t _generation{0};
+  uint32_t _activeWorkers{0};
+
+  // the current job, only written while no worker is running chunks
+  const RangeFn *_job{nullptr};
+  uint32_t _count{0};
+  uint32_t _chunkSize{0};
+  uint32_t _chunkCount{0};
+  std::atomic<uint32_t> _nextChunk{0};
+  std::atomic<uint32_t> _pendingChunks{0};
+};
+//< job_system
@@ -103,7 +103,8 @@ VkPipeline PipelineBuilder::build_pipeline(VkDevice device) {
 
   colorBlending.logicOpEnable = VK_FALSE;
   colorBlending.logicOp = VK_LOGIC_OP_COPY;
-  colorBlending.attachmentCount = 1;
+  // one blend state per color attachment, depth only pipelines have none
+  colorBlending.attachmentCount = _renderInfo.colorAttachmentCount;
   colorBlending.pAttachments = &_colorBlendAttachment;
 
   // completely clear VertexInputStateCreateInfo, as we have no need for it
@@ -158,6 +159,12 @@ void PipelineBuilder::set_shaders(VkShaderModule vertexShader,
       VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
 }
 
+void PipelineBuilder::set_vertex_shader(VkShaderModule vertexShader) {
+  _shaderStages.clear();
+  _shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(
+      VK_SHADER_STAGE_VERTEX_BIT, vertexShader));
+}
+
 void PipelineBuilder::set_input_topology(VkPrimitiveTopology topology) {
   _inputAssembly.topology = topology;
   // we are not going to use primitive restart on the entire tutorial so leave
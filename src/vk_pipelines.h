@@ -21,6 +21,9 @@ public:
   VkPipeline build_pipeline(VkDevice device);
 
   void set_shaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
+  // for depth only pipelines, rasterization still runs without a fragment
+  // stage
+  void set_vertex_shader(VkShaderModule vertexShader);
   void set_input_topology(VkPrimitiveTopology topology);
   void set_polygon_mode(VkPolygonMode mode);
   void set_cull_mode(VkCullModeFlags cullMode, VkFrontFace frontFace);
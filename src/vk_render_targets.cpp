@@ -0,0 +1,263 @@
+#include "vk_render_targets.h"
+
+#include "vk_engine.h"
+#include "vk_initializers.h"
+
+#include <algorithm>
+
+namespace {
+constexpr VkImageUsageFlags ATTACHMENT_USAGES =
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+    VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+bool overlaps(std::pair<uint32_t, uint32_t> a, std::pair<uint32_t, uint32_t> b) {
+  return a.first <= b.second && b.first <= a.second;
+}
+
+VkImageAspectFlags aspect_of(VkFormat format) {
+  if (format == VK_FORMAT_D32_SFLOAT) {
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+  }
+  return VK_IMAGE_ASPECT_COLOR_BIT;
+}
+} // namespace
+
+void RenderTargetPool::begin_frame() { requests.clear(); }
+
+uint32_t RenderTargetPool::request(const RenderTargetDesc &desc,
+                                   uint32_t firstPass, uint32_t lastPass) {
+  requests.push_back({desc, firstPass, lastPass});
+  return (uint32_t)requests.size() - 1;
+}
+
+bool RenderTargetPool::build(VulkanEngine *engine) {
+  if (requests == builtRequests) {
+    return false;
+  }
+
+  // targets whose request did not change keep their image and their place in
+  // memory, so toggling one pass does not reallocate the others
+  std::vector<Target> previous = std::move(targets);
+  std::vector<bool> reused(previous.size(), false);
+  std::vector<bool> kept(requests.size(), false);
+  targets.assign(requests.size(), Target{});
+  for (uint32_t i = 0; i < requests.size(); i++) {
+    for (uint32_t j = 0; j < builtRequests.size(); j++) {
+      if (!reused[j] && builtRequests[j] == requests[i]) {
+        targets[i] = previous[j];
+        reused[j] = true;
+        kept[i] = true;
+        break;
+      }
+    }
+  }
+
+  // frames in flight can still be rendering into the old targets
+  for (uint32_t j = 0; j < previous.size(); j++) {
+    if (!reused[j]) {
+      engine->_frameDeletionQueue.push_image(previous[j].image,
+                                             engine->_frameNumber);
+    }
+  }
+
+  // blocks only keep the lifetimes of the targets still placed in them, the
+  // ones left empty are freed
+  std::vector<uint32_t> remap(blocks.size(), UINT32_MAX);
+  for (uint32_t i = 0; i < requests.size(); i++) {
+    if (kept[i]) {
+      remap[targets[i].block] = 0;
+    }
+  }
+  std::vector<Block> previousBlocks = std::move(blocks);
+  blocks.clear();
+  for (uint32_t b = 0; b < previousBlocks.size(); b++) {
+    if (remap[b] == UINT32_MAX) {
+      engine->_frameDeletionQueue.push_allocation(previousBlocks[b].allocation,
+                                                  engine->_frameNumber);
+      continue;
+    }
+    remap[b] = (uint32_t)blocks.size();
+    blocks.push_back(previousBlocks[b]);
+    blocks.back().lifetimes.clear();
+  }
+  for (uint32_t i = 0; i < requests.size(); i++) {
+    if (kept[i]) {
+      targets[i].block = remap[targets[i].block];
+      blocks[targets[i].block].lifetimes.push_back(
+          {requests[i].firstPass, requests[i].lastPass});
+    }
+  }
+
+  struct Placement {
+    uint32_t request;
+    VkImageCreateInfo info;
+    bool lazy;
+  };
+
+  std::vector<Placement> placements;
+  for (uint32_t i = 0; i < requests.size(); i++) {
+    if (kept[i]) {
+      continue;
+    }
+    const RenderTargetDesc &desc = requests[i].desc;
+
+    Placement placement;
+    placement.request = i;
+    placement.info = vkinit::image_create_info(
+        desc.format, desc.usage,
+        VkExtent3D{desc.extent.width, desc.extent.height, 1});
+    placement.info.mipLevels = desc.mipLevels;
+
+    // targets that are only ever attachments dont need their memory to hold
+    // anything outside of a pass, tilers can skip backing them entirely
+    placement.lazy = (desc.usage & ~ATTACHMENT_USAGES) == 0;
+    if (placement.lazy) {
+      placement.info.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+
+    // ask for the requirements without creating the image first
+    VkDeviceImageMemoryRequirements query{
+        .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+        .pCreateInfo = &placement.info};
+    VkMemoryRequirements2 requirements{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+    vkGetDeviceImageMemoryRequirements(engine->_device, &query, &requirements);
+    targets[i].requirements = requirements.memoryRequirements;
+
+    placements.push_back(placement);
+  }
+
+  // biggest first, so every new block is sized by the first target placed in
+  // it
+  std::sort(placements.begin(), placements.end(),
+            [&](const Placement &a, const Placement &b) {
+              return targets[a.request].requirements.size >
+                     targets[b.request].requirements.size;
+            });
+
+  for (const Placement &placement : placements) {
+    const Request &request = requests[placement.request];
+    const VkMemoryRequirements &reqs = targets[placement.request].requirements;
+    std::pair<uint32_t, uint32_t> lifetime{request.firstPass,
+                                           request.lastPass};
+
+    uint32_t chosen = (uint32_t)blocks.size();
+    for (uint32_t b = 0; b < blocks.size(); b++) {
+      Block &block = blocks[b];
+      // a block that is already allocated is bound to its memory type
+      uint32_t typeBits = block.allocation != VK_NULL_HANDLE
+                              ? 1u << block.memoryType
+                              : block.requirements.memoryTypeBits;
+      if (block.lazy != placement.lazy ||
+          (typeBits & reqs.memoryTypeBits) == 0 ||
+          block.requirements.size < reqs.size ||
+          block.requirements.alignment < reqs.alignment) {
+        continue;
+      }
+
+      bool free = std::none_of(
+          block.lifetimes.begin(), block.lifetimes.end(),
+          [&](std::pair<uint32_t, uint32_t> other) {
+            return overlaps(lifetime, other);
+          });
+      if (free) {
+        chosen = b;
+        break;
+      }
+    }
+
+    if (chosen == blocks.size()) {
+      Block block{};
+      block.requirements = reqs;
+      block.lazy = placement.lazy;
+      blocks.push_back(block);
+    }
+
+    Block &block = blocks[chosen];
+    block.requirements.memoryTypeBits &= reqs.memoryTypeBits;
+    block.lifetimes.push_back(lifetime);
+    targets[placement.request].block = chosen;
+  }
+
+  for (Block &block : blocks) {
+    if (block.allocation != VK_NULL_HANDLE) {
+      continue;
+    }
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = block.lazy ? VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED
+                                 : VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VmaAllocationInfo info;
+    VkResult result =
+        vmaAllocateMemory(engine->_allocator, &block.requirements, &allocInfo,
+                          &block.allocation, &info);
+    if (result != VK_SUCCESS && block.lazy) {
+      // no lazily allocated memory type on this device, desktop gpus end up
+      // here
+      block.lazy = false;
+      allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+      result = vmaAllocateMemory(engine->_allocator, &block.requirements,
+                                 &allocInfo, &block.allocation, &info);
+    }
+    VK_CHECK(result);
+    block.memoryType = info.memoryType;
+  }
+
+  for (const Placement &placement : placements) {
+    Target &target = targets[placement.request];
+    const RenderTargetDesc &desc = requests[placement.request].desc;
+
+    // the image does not own its memory, so allocation stays null and the
+    // deletion queue only destroys the image itself
+    target.image.imageFormat = desc.format;
+    target.image.imageExtent =
+        VkExtent3D{desc.extent.width, desc.extent.height, 1};
+    target.image.allocation = VK_NULL_HANDLE;
+
+    VK_CHECK(vmaCreateAliasingImage2(engine->_allocator,
+                                     blocks[target.block].allocation, 0,
+                                     &placement.info, &target.image.image));
+
+    VkImageViewCreateInfo view_info = vkinit::imageview_create_info(
+        desc.format, target.image.image, aspect_of(desc.format));
+    view_info.subresourceRange.levelCount = desc.mipLevels;
+    VK_CHECK(vkCreateImageView(engine->_device, &view_info, nullptr,
+                               &target.image.imageView));
+  }
+
+  _stats = {};
+  _stats.targets = (uint32_t)targets.size();
+  _stats.blocks = (uint32_t)blocks.size();
+  for (const Target &target : targets) {
+    _stats.dedicatedBytes += target.requirements.size;
+  }
+  for (const Block &block : blocks) {
+    _stats.allocatedBytes += block.requirements.size;
+    if (block.lazy) {
+      _stats.lazyBytes += block.requirements.size;
+    }
+  }
+
+  builtRequests = requests;
+  return true;
+}
+
+void RenderTargetPool::destroy(VulkanEngine *engine) {
+  release(engine);
+  builtRequests.clear();
+}
+
+void RenderTargetPool::release(VulkanEngine *engine) {
+  // frames in flight can still be rendering into the old targets
+  for (const Target &target : targets) {
+    engine->_frameDeletionQueue.push_image(target.image, engine->_frameNumber);
+  }
+  for (const Block &block : blocks) {
+    engine->_frameDeletionQueue.push_allocation(block.allocation,
+                                                engine->_frameNumber);
+  }
+  targets.clear();
+  blocks.clear();
+}
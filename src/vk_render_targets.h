@@ -0,0 +1,85 @@
+#pragma once
+#include "vk_types.h"
+
+class VulkanEngine;
+
+//> render_target_pool
+struct RenderTargetDesc {
+  VkFormat format;
+  VkExtent2D extent;
+  VkImageUsageFlags usage;
+  // the view covers every level, passes that write single levels make their
+  // own views
+  uint32_t mipLevels = 1;
+
+  bool operator==(const RenderTargetDesc &) const = default;
+};
+
+// Hands out the per-frame render targets. Every frame the passes request the
+// targets they need together with the first and last pass that touches them,
+// and targets whose pass ranges dont overlap share memory. The images are
+// kept as long as their request stays the same, so the steady state costs a
+// vector compare and a changed request only replaces its own target. Contents
+// never survive between frames: another target may have written the shared
+// memory in between, so the first pass that uses a target has to transition
+// it from VK_IMAGE_LAYOUT_UNDEFINED.
+struct RenderTargetPool {
+  struct Request {
+    RenderTargetDesc desc;
+    uint32_t firstPass;
+    uint32_t lastPass;
+
+    bool operator==(const Request &) const = default;
+  };
+
+  struct Stats {
+    uint32_t targets;
+    uint32_t blocks;
+    // what one allocation per target would have cost
+    VkDeviceSize dedicatedBytes;
+    VkDeviceSize allocatedBytes;
+    // part of allocatedBytes that is lazily allocated and may never be backed
+    VkDeviceSize lazyBytes;
+  };
+
+  void begin_frame();
+  uint32_t request(const RenderTargetDesc &desc, uint32_t firstPass,
+                   uint32_t lastPass);
+
+  // returns true when any image was replaced and handles need refreshing
+  bool build(VulkanEngine *engine);
+
+  const AllocatedImage &get(uint32_t target) const {
+    return targets[target].image;
+  }
+
+  const Stats &stats() const { return _stats; }
+
+  void destroy(VulkanEngine *engine);
+
+private:
+  struct Target {
+    AllocatedImage image;
+    uint32_t block;
+    VkMemoryRequirements requirements;
+  };
+
+  struct Block {
+    VmaAllocation allocation;
+    VkMemoryRequirements requirements;
+    // the type the allocation ended up in, targets placed later must allow it
+    uint32_t memoryType;
+    bool lazy;
+    // pass ranges of the targets placed in this block
+    std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+  };
+
+  void release(VulkanEngine *engine);
+
+  std::vector<Request> requests;
+  std::vector<Request> builtRequests;
+  std::vector<Target> targets;
+  std::vector<Block> blocks;
+  Stats _stats{};
+};
+//< render_target_pool
@@ -0,0 +1,205 @@
+#include "vk_texture_streaming.h"
+
+#include "vk_engine.h"
+#include "vk_images.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+uint32_t TextureStreamer::add_texture(VulkanEngine *engine,
+                                      TextureData &&texture) {
+  StreamedTexture streamed{};
+  streamed.source = std::move(texture);
+
+  // the tail starts at the first level that fits in tailSize, textures that
+  // are small to begin with are fully resident straight away
+  uint32_t levelCount = (uint32_t)streamed.source.levels.size();
+  streamed.tailMip = levelCount - 1;
+  for (uint32_t i = 0; i < levelCount; i++) {
+    VkExtent3D extent = streamed.source.levels[i].extent;
+    if (std::max(extent.width, extent.height) <= tailSize) {
+      streamed.tailMip = i;
+      break;
+    }
+  }
+  streamed.residentMip = streamed.tailMip;
+  streamed.wantedMip = streamed.tailMip;
+
+  // queued like any other image upload, so a batch around the load puts
+  // every tail into one submit. Later rebuilds copy levels out of it
+  streamed.image = engine->create_image(
+      streamed.source,
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      streamed.tailMip);
+
+  textures.push_back(std::move(streamed));
+  return (uint32_t)textures.size() - 1;
+}
+
+void TextureStreamer::request(uint32_t texture, float screenPixels) {
+  if (texture == INVALID_TEXTURE) {
+    return;
+  }
+
+  StreamedTexture &streamed = textures[texture];
+  VkExtent3D extent = streamed.source.extent;
+  float size = (float)std::max(extent.width, extent.height);
+  float pixels = std::max(screenPixels, 1.f);
+
+  // one texel per pixel is enough, every halving of the footprint drops a
+  // level. wantedMip starts at the tail each frame so this never goes past it
+  uint32_t mip = 0;
+  if (size > pixels) {
+    mip = (uint32_t)std::floor(std::log2(size / pixels));
+  }
+  streamed.wantedMip = std::min(streamed.wantedMip, mip);
+}
+
+void TextureStreamer::update(VulkanEngine *engine, VkCommandBuffer cmd) {
+  CPU_ZONE("texture streaming");
+  changed.clear();
+
+  size_t budget = uploadBudget;
+  for (uint32_t i = 0; i < textures.size(); i++) {
+    StreamedTexture &texture = textures[i];
+
+    uint32_t target = texture.residentMip;
+    if (texture.wantedMip < texture.residentMip) {
+      // stream in one level at a time, finer levels come on later frames
+      texture.idleFrames = 0;
+      target = texture.residentMip - 1;
+    } else if (texture.wantedMip > texture.residentMip) {
+      // only give memory back once the texture has been oversized for a
+      // while, so it doesnt bounce when the camera moves back and forth
+      texture.idleFrames++;
+      if (texture.idleFrames >= evictFrames) {
+        texture.idleFrames = 0;
+        target = texture.residentMip + 1;
+      }
+    } else {
+      texture.idleFrames = 0;
+    }
+
+    texture.wantedMip = texture.tailMip;
+
+    if (target == texture.residentMip) {
+      continue;
+    }
+
+    // only a level streaming in is uploaded, the levels the image keeps are
+    // copied on the gpu. The first upload of a frame always goes through, so
+    // a single level bigger than the budget cant stall streaming forever
+    size_t cost =
+        target < texture.residentMip ? texture.source.levels[target].size : 0;
+    if (cost > budget && budget != uploadBudget) {
+      continue;
+    }
+    budget = cost > budget ? 0 : budget - cost;
+
+    rebuild(engine, cmd, i, target);
+  }
+}
+
+void TextureStreamer::destroy(VulkanEngine *engine) {
+  for (StreamedTexture &texture : textures) {
+    engine->_frameDeletionQueue.push_image(texture.image, engine->_frameNumber);
+  }
+  textures.clear();
+  changed.clear();
+}
+
+size_t TextureStreamer::resident_bytes() const {
+  size_t bytes = 0;
+  for (const StreamedTexture &texture : textures) {
+    bytes += level_range_size(texture, texture.residentMip);
+  }
+  return bytes;
+}
+
+void TextureStreamer::rebuild(VulkanEngine *engine, VkCommandBuffer cmd,
+                              uint32_t index, uint32_t residentMip) {
+  StreamedTexture &texture = textures[index];
+  const TextureData &source = texture.source;
+  uint32_t oldMip = texture.residentMip;
+
+  // level 0 of the new image is residentMip of the source
+  uint32_t levelCount = (uint32_t)source.levels.size() - residentMip;
+  AllocatedImage image = engine->allocate_image(
+      source.levels[residentMip].extent, source.format,
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+          VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      levelCount);
+  vkutil::transition_image(cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+  // levels the old image already holds are copied over on the gpu. Frames
+  // still sampling it were submitted earlier, so the barrier waits for them
+  std::vector<VkImageCopy> kept;
+  for (uint32_t mip = std::max(residentMip, oldMip);
+       mip < source.levels.size(); mip++) {
+    VkImageCopy copy{};
+    copy.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip - oldMip, 0, 1};
+    copy.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip - residentMip, 0, 1};
+    copy.extent = source.levels[mip].extent;
+    kept.push_back(copy);
+  }
+  vkutil::transition_image(cmd, texture.image.image,
+                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  vkCmdCopyImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                 image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 (uint32_t)kept.size(), kept.data());
+
+  // only the levels finer than the old image come from the cpu, one level
+  // per step when streaming in and none when evicting
+  if (residentMip < oldMip) {
+    size_t firstOffset = source.levels[residentMip].offset;
+    size_t size = source.levels[oldMip].offset - firstOffset;
+
+    // the new levels are contiguous in the source, one memcpy covers them
+    AllocatedBuffer staging =
+        engine->create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              VMA_MEMORY_USAGE_CPU_TO_GPU);
+    memcpy(staging.info.pMappedData, source.data.data() + firstOffset, size);
+
+    std::vector<VkBufferImageCopy> copies;
+    for (uint32_t mip = residentMip; mip < oldMip; mip++) {
+      const TextureLevel &level = source.levels[mip];
+
+      VkBufferImageCopy copyRegion = {};
+      copyRegion.bufferOffset = level.offset - firstOffset;
+      copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      copyRegion.imageSubresource.mipLevel = mip - residentMip;
+      copyRegion.imageSubresource.baseArrayLayer = 0;
+      copyRegion.imageSubresource.layerCount = 1;
+      copyRegion.imageExtent = level.extent;
+      copies.push_back(copyRegion);
+    }
+    vkCmdCopyBufferToImage(cmd, staging.buffer, image.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           (uint32_t)copies.size(), copies.data());
+    engine->_frameDeletionQueue.push_buffer(staging, engine->_frameNumber);
+  }
+
+  vkutil::transition_image(cmd, image.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  // frames still in flight may sample the old image, so it goes through the
+  // frame queue
+  engine->_frameDeletionQueue.push_image(texture.image, engine->_frameNumber);
+
+  texture.image = image;
+  texture.residentMip = residentMip;
+  changed.push_back(index);
+}
+
+size_t TextureStreamer::level_range_size(const StreamedTexture &texture,
+                                         uint32_t firstMip) const {
+  size_t bytes = 0;
+  for (uint32_t i = firstMip; i < texture.source.levels.size(); i++) {
+    bytes += texture.source.levels[i].size;
+  }
+  return bytes;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "loader/vk_ktx.h"
+#include "vk_types.h"
+
+class VulkanEngine;
+
+//> streamed_texture
+// A texture whose gpu image only holds the levels that are worth having at
+// the moment. The image is reallocated at the resident size whenever the
+// residency changes, so its view never covers a level that is not uploaded
+// and vram follows what is on screen.
+struct StreamedTexture {
+  AllocatedImage image;
+  // keeps every level on the cpu, streaming copies out of it
+  TextureData source;
+
+  // finest level currently in the image, everything coarser is resident too
+  uint32_t residentMip;
+  // coarsest level that is always resident
+  uint32_t tailMip;
+  // finest level asked for by any surface this frame
+  uint32_t wantedMip;
+  // frames the wanted level has stayed coarser than the resident one
+  uint32_t idleFrames;
+};
+
+struct TextureStreamer {
+  static constexpr uint32_t INVALID_TEXTURE = UINT32_MAX;
+
+  // levels up to this size are uploaded when the texture is added
+  uint32_t tailSize = 128;
+  // bytes of level data copied per frame
+  size_t uploadBudget = 8 * 1024 * 1024;
+  // frames a texture has to stay oversized before its finest level is dropped
+  uint32_t evictFrames = 240;
+
+  std::vector<StreamedTexture> textures;
+  // textures whose image changed during the last update
+  std::vector<uint32_t> changed;
+
+  // queues the upload of the mip tail through the engine's image uploads,
+  // the rest streams in through update()
+  uint32_t add_texture(VulkanEngine *engine, TextureData &&texture);
+
+  // called per surface with the size it covers on screen, in pixels
+  void request(uint32_t texture, float screenPixels);
+
+  // records the uploads for this frame into cmd, retiring replaced images
+  // through the frame deletion queue
+  void update(VulkanEngine *engine, VkCommandBuffer cmd);
+
+  void destroy(VulkanEngine *engine);
+
+  size_t resident_bytes() const;
+
+private:
+  void rebuild(VulkanEngine *engine, VkCommandBuffer cmd, uint32_t texture,
+               uint32_t residentMip);
+  size_t level_range_size(const StreamedTexture &texture,
+                          uint32_t firstMip) const;
+};
+//< streamed_texture
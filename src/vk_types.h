@@ -44,6 +44,19 @@ struct GPUGLTFMaterial {
 
 static_assert(sizeof(GPUGLTFMaterial) == 256);
 
+// entry of the bindless material table, found through
+// GPUInstanceData::materialIndex
+struct GPUMaterialData {
+  glm::vec4 colorFactors;
+  glm::vec4 metal_rough_factors;
+  // slots in the bindless texture array
+  uint32_t colorTexture;
+  uint32_t metalRoughTexture;
+  uint32_t padding[2];
+};
+
+static_assert(sizeof(GPUMaterialData) == 48);
+
 struct GPUSceneData {
   glm::mat4 view;
   glm::mat4 proj;
@@ -53,17 +66,31 @@ struct GPUSceneData {
   glm::vec4 sunlightColor;
 };
 
+struct ComputePushConstants {
+  glm::vec4 data1;
+  glm::vec4 data2;
+  glm::vec4 data3;
+  glm::vec4 data4;
+};
+
 //> mat_types
 enum class MaterialPass : uint8_t { MainColor, Transparent, Other };
 struct MaterialPipeline {
   VkPipeline pipeline;
   VkPipelineLayout layout;
+  // same shading, but testing EQUAL against depth laid down by the depth
+  // pre-pass without writing it. Null for pipelines the pre-pass skips
+  VkPipeline depthEqualPipeline;
 };
 
 struct MaterialInstance {
   MaterialPipeline *pipeline;
   VkDescriptorSet materialSet;
   MaterialPass passType;
+  // bindless variant of pipeline, and the material's entry in the bindless
+  // material table
+  MaterialPipeline *bindlessPipeline;
+  uint32_t materialIndex{0};
 };
 //< mat_types
 //> vbuf_types
@@ -76,12 +103,23 @@ struct Vertex {
   glm::vec4 color;
 };
 
+// object space bounds of a surface, as a box and as the sphere around it
+struct Bounds {
+  glm::vec3 origin;
+  float sphereRadius;
+  glm::vec3 extents;
+};
+
 // holds the resources needed for a mesh
 struct GPUMeshBuffers {
 
   AllocatedBuffer indexBuffer;
   AllocatedBuffer vertexBuffer;
   VkDeviceAddress vertexBufferAddress;
+  // tightly packed copy of the vertex positions, so depth only passes fetch
+  // 12 bytes per vertex instead of a whole Vertex
+  AllocatedBuffer positionBuffer;
+  VkDeviceAddress positionBufferAddress;
 };
 
 // push constants for our mesh object draws
@@ -89,6 +127,69 @@ struct GPUDrawPushConstants {
   glm::mat4 worldMatrix;
   VkDeviceAddress vertexBuffer;
 };
+
+// per instance data of mesh.vert, read from the instance buffer with
+// gl_InstanceIndex. Carrying the vertex buffer here lets one indirect call
+// draw several meshes
+struct GPUInstanceData {
+  glm::mat4 worldMatrix;
+  VkDeviceAddress vertexBuffer;
+  // GPUMeshBuffers::positionBuffer, read by the depth pre-pass
+  VkDeviceAddress positionBuffer;
+  // MaterialInstance::materialIndex, for the bindless pipelines
+  uint32_t materialIndex;
+  uint32_t padding[3];
+};
+
+// push constants for instanced draws, the same for every draw of a frame
+struct GPUInstancedPushConstants {
+  VkDeviceAddress instanceBuffer;
+};
+
+// header of the cull object buffer, the GPUCullObjects follow it
+struct GPUCullData {
+  glm::vec4 frustum[6];
+  glm::mat4 view;
+  // P00, P11, P22 and P32 of the projection, enough to find the screen
+  // rectangle of a view space sphere and the depth of its nearest point
+  glm::vec4 projection;
+  glm::vec2 pyramidSize;
+  // spheres crossing the near plane are never occluded
+  float znear;
+  uint32_t objectCount;
+};
+
+// input of cull.comp, one per draw in sorted order
+struct GPUCullObject {
+  // object space bounding sphere, radius in w
+  glm::vec4 sphere;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  // indirect call the draw belongs to and the first command slot of it
+  uint32_t group;
+  uint32_t groupStart;
+  // index of the draw before sorting. It stays the same from frame to frame
+  // as long as the scene does, so it keys the visibility of the last frame
+  uint32_t object;
+  uint32_t padding[3];
+};
+
+struct CullPushConstants {
+  VkDeviceAddress cullData;
+  VkDeviceAddress instances;
+  VkDeviceAddress commands;
+  VkDeviceAddress counts;
+  VkDeviceAddress visibility;
+  // VulkanEngine::CullPhase
+  uint32_t phase;
+  uint32_t groupCount;
+};
+
+struct DepthReducePushConstants {
+  glm::vec2 outSize;
+  // part of the source that holds the frame, in uv
+  glm::vec2 uvScale;
+};
 //< vbuf_types
 
 //> node_types
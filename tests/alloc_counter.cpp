@@ -0,0 +1,28 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+thread_local uint64_t threadAllocations = 0;
+
+void *counted_alloc(std::size_t size) {
+  threadAllocations++;
+  // malloc(0) may return null, operator new may not
+  if (void *ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+} // namespace
+
+uint64_t alloccount::thread_allocations() { return threadAllocations; }
+
+// the array and nothrow forms of the standard library forward to these, the
+// aligned forms are left alone and not counted
+void *operator new(std::size_t size) { return counted_alloc(size); }
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+//> alloc_counter
+// Counts heap allocations per thread, by replacing the global operator new.
+// Only linked into tests, never into the engine. Each thread only ever
+// touches its own counter, so a thread can measure a stretch of its own work
+// without other threads showing up in it.
+namespace alloccount {
+
+// allocations made by the calling thread so far
+uint64_t thread_allocations();
+
+} // namespace alloccount
+//< alloc_counter
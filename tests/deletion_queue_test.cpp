@@ -0,0 +1,102 @@
+#include "alloc_counter.h"
+#include "vk_deletion_queue.h"
+
+#include <cstdlib>
+
+// Pushes buffers, images and views through a DeferredDeletionQueue the way
+// the frame loop does and checks that, once the queue's vectors have grown to
+// their working size, pushing and retiring never touch the heap.
+//
+// Nothing here talks to a gpu. The destroy calls the queue makes are
+// replaced below and only counted, handles are made up numbers.
+
+namespace {
+constexpr uint64_t FRAMES_IN_FLIGHT = 3;
+constexpr uint64_t WARMUP_FRAMES = 16;
+constexpr uint64_t TEST_FRAMES = 1000;
+
+uint64_t destroyedBuffers = 0;
+uint64_t destroyedImages = 0;
+uint64_t destroyedViews = 0;
+
+template <typename T> T handle(uint64_t value) { return (T)(uintptr_t)value; }
+} // namespace
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImageView(VkDevice, VkImageView,
+                                              const VkAllocationCallbacks *) {
+  destroyedViews++;
+}
+VKAPI_ATTR void VKAPI_CALL vkDestroyPipeline(VkDevice, VkPipeline,
+                                             const VkAllocationCallbacks *) {}
+VKAPI_ATTR void VKAPI_CALL vkDestroySampler(VkDevice, VkSampler,
+                                            const VkAllocationCallbacks *) {}
+VKAPI_ATTR void VKAPI_CALL
+vkDestroyDescriptorPool(VkDevice, VkDescriptorPool,
+                        const VkAllocationCallbacks *) {}
+VMA_CALL_PRE void VMA_CALL_POST vmaDestroyImage(VmaAllocator, VkImage,
+                                                VmaAllocation) {
+  destroyedImages++;
+}
+VMA_CALL_PRE void VMA_CALL_POST vmaDestroyBuffer(VmaAllocator, VkBuffer,
+                                                 VmaAllocation) {
+  destroyedBuffers++;
+}
+VMA_CALL_PRE void VMA_CALL_POST vmaFreeMemory(VmaAllocator, VmaAllocation) {}
+
+int main() {
+  DeferredDeletionQueue queue;
+  VkDevice device = VK_NULL_HANDLE;
+  VmaAllocator allocator = VK_NULL_HANDLE;
+
+  // a few objects of every kind per frame, like a streamed texture level or
+  // a rebuilt render target would retire
+  auto simulate_frame = [&](uint64_t frame) {
+    for (uint64_t i = 0; i < 4; i++) {
+      uint64_t id = frame * 16 + i + 1;
+      AllocatedBuffer buffer{};
+      buffer.buffer = handle<VkBuffer>(id);
+      buffer.allocation = handle<VmaAllocation>(id);
+      queue.push_buffer(buffer, frame);
+
+      AllocatedImage image{};
+      image.image = handle<VkImage>(id);
+      image.imageView = handle<VkImageView>(id);
+      image.allocation = handle<VmaAllocation>(id);
+      queue.push_image(image, frame);
+
+      queue.push_image_view(handle<VkImageView>(id + 8), frame);
+    }
+    if (frame >= FRAMES_IN_FLIGHT) {
+      queue.retire(device, allocator, frame - FRAMES_IN_FLIGHT);
+    }
+  };
+
+  uint64_t frame = 0;
+  for (; frame < WARMUP_FRAMES; frame++) {
+    simulate_frame(frame);
+  }
+
+  uint64_t allocationsBefore = alloccount::thread_allocations();
+  for (; frame < WARMUP_FRAMES + TEST_FRAMES; frame++) {
+    simulate_frame(frame);
+  }
+  uint64_t allocations = alloccount::thread_allocations() - allocationsBefore;
+
+  // views go with their images and on their own
+  uint64_t retiredFrames = frame - FRAMES_IN_FLIGHT;
+  bool destroyed = destroyedBuffers == retiredFrames * 4 &&
+                   destroyedImages == retiredFrames * 4 &&
+                   destroyedViews == retiredFrames * 8;
+
+  queue.flush(device, allocator);
+
+  fmt::println("{} frames after warm up: {} heap allocations, {} buffers, "
+               "{} images and {} views destroyed",
+               TEST_FRAMES, allocations, destroyedBuffers, destroyedImages,
+               destroyedViews);
+  if (allocations != 0 || !destroyed) {
+    fmt::println("FAILED");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}